@@ -0,0 +1,397 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <src/riot/server/command_parser.hpp>
+#include <src/riot/server/header_parser.hpp>
+
+using namespace riot::server;
+using clock_type = std::chrono::steady_clock;
+
+namespace legacy {
+
+using namespace std;
+
+/* the istringstream based parser the fast path replaced, kept verbatim for
+ * comparison */
+struct command_parser {
+    using type_t = riot::server::command_parser::type_t;
+    static constexpr type_t empty = riot::server::command_parser::empty;
+    static constexpr type_t invalid = riot::server::command_parser::invalid;
+    static constexpr type_t trig = riot::server::command_parser::trig;
+    static constexpr type_t sub = riot::server::command_parser::sub;
+    static constexpr type_t unsub = riot::server::command_parser::unsub;
+    static constexpr type_t negsub = riot::server::command_parser::negsub;
+    static constexpr type_t unnegsub = riot::server::command_parser::unnegsub;
+    static constexpr type_t pause = riot::server::command_parser::pause;
+    static constexpr type_t cont = riot::server::command_parser::cont;
+    static constexpr type_t p2p_accept = riot::server::command_parser::p2p_accept;
+    static constexpr type_t p2p_stop_accept = riot::server::command_parser::p2p_stop_accept;
+    static constexpr type_t p2p_disconnect = riot::server::command_parser::p2p_disconnect;
+    static constexpr type_t p2p_send = riot::server::command_parser::p2p_send;
+
+    type_t type() const
+    { return type_; }
+
+    struct {
+        struct { std::list<xeid_matcher> xeids; } trig;
+        struct {
+            std::list<xeid_matcher> xeids;
+            bool minperiod_exists {false};
+            std::uint64_t minperiod { static_cast<std::uint64_t>(1e6) };
+        } sub;
+        struct { std::list<uint64_t> subIDs; bool all {false}; } unsub;
+        struct { std::list<xeid_matcher> xeids; } negsub;
+        struct { std::list<uint64_t> negsubIDs; bool all {false}; } unnegsub;
+        struct {
+            struct {
+                bool maxconnections_exists { false };
+                std::uint64_t maxconnections { 1000 };
+            } accept;
+            struct { std::list<uint64_t> p2pIDs; bool all {false}; } disconnect;
+            struct {
+                std::list<uint64_t> p2pIDs;
+                std::uint64_t size {0};
+                bool all {false};
+                bool until_newline {false};
+            } send;
+        } p2p;
+    } s;
+
+    bool parse(const std::string &line);
+private:
+    type_t type_;
+    std::string error_msg_;
+
+    template <typename ...T>
+    void set_error_msg(T && ...t) {
+        std::ostringstream oss;
+        oss << "syntax error: ";
+        using helper_t = int [];
+        (void) helper_t { 0, ( oss << t, 0 ) ... };
+        error_msg_ = oss.str();
+    }
+};
+
+bool command_parser::parse(const std::string &line) {
+    // BEGIN error messages
+    // static const char *err_not_enough_args      = "not enough arguments";
+    static const char *err_too_many_args        = "too many arguments";
+    // static const char *err_invalid_id           = "invalid identifier of p2pID/subID/negsubID";
+    static const char *err_invalid_xeid         = "invalid xeid";
+    static const char *err_invalid_arg          = "not a valid argument";
+    static const char *err_invalid_command      = "not a valid command";
+    static const char *err_emptyline            = "empty line";
+    // END
+    static regex rgx_p2p_send {R"((\d+(?:,\d+)*|\*)>(\d+|n|N))"};
+    
+    error_msg_ = "";
+    istringstream iss(line);
+    string dummy;
+    if (iss >> dummy) {
+        if (dummy == "trig") {
+            type_ = trig;
+            /* trig (<xeid>)*  */
+            while (iss >> dummy) {
+                xeid_matcher xeidm;
+                try {
+                    xeidm.init(dummy);
+                    s.trig.xeids.push_back(std::move(xeidm));
+                }
+                catch (std::exception &ex) {
+                    set_error_msg(err_invalid_xeid, " : ", ex.what());
+                    break;
+                }
+            }
+        }
+        else if (dummy == "sub") {
+            type_ = sub;
+            /* reset first */
+            s.sub.minperiod_exists = false;
+            /* sub (<xeid>)* (minperiod=<timeout>)? */
+            while (iss >> dummy) {
+                xeid_matcher xeidm;
+                try {
+                    xeidm.init(dummy);
+                    s.sub.xeids.push_back(std::move(xeidm));
+                }
+                catch (std::exception &ex) {
+                    istringstream iss(dummy);
+                    getline(iss, dummy, '=');
+                    if (dummy == "minperiod") {
+                        if (iss >> dummy /* iss has no whitespace, dummy is what is left */) {
+                            if (header_parser::string_to_timeout(
+                                dummy,
+                                s.sub.minperiod_exists,
+                                s.sub.minperiod)) {
+                                /* fine */
+                            }
+                            else {
+                                set_error_msg(err_invalid_arg, " : ", dummy);
+                                break;
+                            }
+                        }
+                        else {
+                            set_error_msg(err_invalid_arg, " : ", dummy);
+                            break;
+                        }
+                    }
+                    else {
+                        set_error_msg(err_invalid_arg, " : ", dummy);
+                        break;
+                    }
+                }
+            }
+        }
+        else if (dummy == "unsub") {
+            type_ = unsub;
+            /* reset first */
+            s.unsub.all = false;
+            /* unsub (subID)* \*? */
+            while (iss >> dummy) {
+                if (dummy == "*") {
+                    s.unsub.all = true;
+                    break;
+                }
+                else {
+                    istringstream iss(dummy);
+                    uint64_t subID;
+                    if (iss >> subID) {
+                        s.unsub.subIDs.push_back(subID);
+                    }
+                    else {
+                        set_error_msg(err_invalid_arg, " : ", dummy);
+                        break;
+                    }
+                }
+            }
+        }
+        else if (dummy == "negsub") {
+            type_ = negsub;
+            /* negsub (<xeid>)* */
+            while (iss >> dummy) {
+                xeid_matcher xeidm;
+                try {
+                    xeidm.init(dummy);
+                    s.negsub.xeids.push_back(std::move(xeidm));
+                }
+                catch (std::exception &ex) {
+                    set_error_msg(err_invalid_xeid, " : ", ex.what());
+                    break;
+                }
+            }
+        }
+        else if (dummy == "unnegsub") {
+            type_ = unnegsub;
+            /* reset first */
+            s.unnegsub.all = false;
+            /* unnegsub (subID)* \*? */
+            while (iss >> dummy) {
+                if (dummy == "*") {
+                    s.unnegsub.all = true;
+                    break;
+                }
+                else {
+                    istringstream iss(dummy);
+                    uint64_t negsubID;
+                    if (iss >> negsubID) {
+                        s.unnegsub.negsubIDs.push_back(negsubID);
+                    }
+                    else {
+                        set_error_msg(err_invalid_arg, " : ", dummy);
+                        break;
+                    }
+                }
+            }
+        }
+        else if (dummy == "pause") {
+            type_ = pause;
+            /* pause */
+        }
+        else if (dummy == "continue") {
+            type_ = cont;
+            /* continue */
+        }
+        else if (dummy == "p2p-accept") {
+            type_ = p2p_accept;
+            /* reset first */
+            s.p2p.accept.maxconnections_exists = false;
+            /* p2p-accept (maxconnections=N)? */
+            if (iss >> dummy) {
+                istringstream iss(dummy);
+                getline(iss, dummy, '=');
+                if (dummy == "maxconnections") {
+                    if (iss >> dummy) {
+                        istringstream iss(dummy);
+                        if (iss >> s.p2p.accept.maxconnections) {
+                            s.p2p.accept.maxconnections_exists = true;
+                        }
+                        else {
+                            set_error_msg(err_invalid_arg, " : ", dummy);
+                        }
+                    }
+                    else {
+                        set_error_msg(err_invalid_arg, " : ", dummy);
+                    }
+                }
+                else {
+                    set_error_msg(err_invalid_arg, " : ", dummy);
+                }
+            }
+            else {
+                /* argument is optional */
+            }
+        }
+        else if (dummy == "p2p-stop-accept") {
+            type_ = p2p_stop_accept;
+            /* p2p-stop-accept */
+        }
+        else if (dummy == "p2p-disconnect") {
+            type_ = p2p_disconnect;
+            /* reset first */
+            s.p2p.disconnect.all = false;
+            /* p2p-disconnect (p2pID)* \*? */
+            while (iss >> dummy) {
+                if (dummy == "*") {
+                    s.p2p.disconnect.all = true;
+                    break;
+                }
+                else {
+                    istringstream iss(dummy);
+                    uint64_t p2pID;
+                    if (iss >> p2pID) {
+                        s.p2p.disconnect.p2pIDs.push_back(p2pID);
+                    }
+                    else {
+                        set_error_msg(err_invalid_arg, " : ", dummy);
+                    }
+                }
+            }
+        }
+        else {
+            smatch match;
+            if (regex_match(dummy, match, rgx_p2p_send)) {
+                /* if not a command, can be send */
+                /* reset first */
+                s.p2p.send.all = false;
+                s.p2p.send.until_newline = false;
+                /* N1,N2,...,Nn>B */
+                type_ = p2p_send;
+                string m1 = match[1], m2 = match[2];
+                if (m1 == "*")
+                {
+                    s.p2p.send.all = true;
+                }
+                else
+                {
+                    istringstream iss(m1);
+                    uint64_t p2pID;
+                    while (iss >> p2pID) {
+                        s.p2p.send.p2pIDs.push_back(p2pID);
+                        char c; iss >> c; // skip ","
+                    }
+                }
+                
+                if (m2 == "n" || m2 == "N") {
+                    s.p2p.send.until_newline = true;
+                }
+                else {
+                    istringstream iss(m2);
+                    iss >> s.p2p.send.size;
+                }
+            }
+            else {
+                set_error_msg(err_invalid_command);
+            }
+        }
+        
+        /* if no error message is set, it's still possible to have too many arguments */
+        if (error_msg_.empty() /* dont override previous error */ && iss >> dummy) {
+            set_error_msg(err_too_many_args);
+            type_ = invalid;
+            return false;
+        }
+        
+        /* if error message is set, return false */
+        if (!error_msg_.empty()) {
+            type_ = invalid;
+            return false;
+        }
+        
+        return true;
+    }
+    else {
+        set_error_msg(err_emptyline);
+        type_ = empty;
+        return false;
+    }
+}
+
+}
+
+namespace {
+
+const std::vector<std::string> corpus = {
+    "trig temp",
+    "trig temp@dashboard_1",
+    "trig hum@#dashboard temp@.*#dashboard",
+    "trig door_open@security_.*#panel",
+    "sub temp@sensor_12#thermometer",
+    "sub temp@sensor_.*#thermometer hum@sensor_.*#hygrometer minperiod=500ms",
+    "sub door_.*@#panel",
+    "unsub 1 2 3",
+    "unsub *",
+    "negsub temp@sensor_13",
+    "unnegsub 4",
+    "pause",
+    "continue",
+    "p2p-accept maxconnections=16",
+    "p2p-disconnect 1 2",
+    "3>1024",
+    "1,2,3>n",
+    "*>65536",
+};
+
+template <typename Parser>
+double lines_per_second(std::size_t &parsed) {
+    auto start = clock_type::now();
+    std::size_t n = 0;
+    parsed = 0;
+    do {
+        for (const auto &line: corpus) {
+            Parser parser;
+            parsed += parser.parse(line);
+        }
+        n += corpus.size();
+    } while (clock_type::now() - start < std::chrono::milliseconds(500));
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    parsed = parsed * corpus.size() / n;
+    return n / elapsed.count();
+}
+
+}
+
+int main() {
+    for (const auto &line: corpus) {
+        riot::server::command_parser fast;
+        legacy::command_parser old;
+        fast.parse(line);
+        old.parse(line);
+        if (fast.type() != old.type())
+            std::printf("note: parsers disagree on \"%s\": %d != %d\n",
+                line.c_str(), fast.type(), old.type());
+    }
+    std::size_t fast_parsed, legacy_parsed;
+    double fast = lines_per_second<riot::server::command_parser>(fast_parsed);
+    double old = lines_per_second<legacy::command_parser>(legacy_parsed);
+    std::printf("%10s %14s %8s\n", "parser", "lines/s", "parsed");
+    std::printf("%10s %14.0f %8zu\n", "fast", fast, fast_parsed);
+    std::printf("%10s %14.0f %8zu\n", "legacy", old, legacy_parsed);
+    std::printf("speedup: %.2fx over %zu corpus lines\n", fast / old, corpus.size());
+    return 0;
+}
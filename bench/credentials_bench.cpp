@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <src/riot/server/credential_store.hpp>
+
+using namespace riot::server;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const std::size_t entries = 100000;
+const std::string password = "s3cret";
+
+/* a file of devices sharing the same hash, half of them open */
+std::string make_file(const std::string &hash) {
+    std::ostringstream oss;
+    oss << "# " << entries << " devices\n";
+    for (std::size_t i = 0; i < entries; ++i)
+        oss << "device dev" << i << ' ' << (i % 2 ? hash : "*") << '\n';
+    oss << "type sensor " << hash << " multiple\n";
+    return oss.str();
+}
+
+double load_ms(credential_store &store, const std::string &file) {
+    std::istringstream in(file);
+    std::string error;
+    auto start = clock_type::now();
+    if (!store.load(in, error))
+        std::printf("load failed: %s\n", error.c_str());
+    std::chrono::duration<double, std::milli> elapsed = clock_type::now() - start;
+    return elapsed.count();
+}
+
+/* distinct random devices, open or having the password */
+std::vector<std::string> pick(std::size_t n, bool open) {
+    std::vector<std::size_t> indices(entries / 2);
+    for (std::size_t i = 0; i < indices.size(); ++i)
+        indices[i] = i * 2 + !open;
+    std::shuffle(indices.begin(), indices.end(), std::mt19937(1));
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < n; ++i)
+        names.push_back("dev" + std::to_string(indices[i]));
+    return names;
+}
+
+/* ns per check, cycling through the names */
+double check_ns(const credential_store &store, const std::vector<std::string> &names, std::size_t n) {
+    std::size_t allowed = 0;
+    bool multiple;
+    auto start = clock_type::now();
+    for (std::size_t i = 0; i < n; ++i)
+        allowed += store.check(names[i % names.size()], "x", password, multiple);
+    std::chrono::duration<double, std::nano> elapsed = clock_type::now() - start;
+    if (allowed != n)
+        std::printf("unexpected rejections: %zu\n", n - allowed);
+    return elapsed.count() / n;
+}
+
+}
+
+int main() {
+    std::printf("%10s | %10s %14s %14s %14s\n", "iterations",
+        "load ms", "open ns", "derive us", "cached ns");
+    for (unsigned iterations: { 1000, 100000 }) {
+        auto file = make_file(credential_store::hash_password(password, iterations));
+        credential_store store;
+        auto load = load_ms(store, file);
+        auto open = check_ns(store, pick(4096, true), 1000000);
+        /* the first check of each device derives the key, the next ones
+         * hit the cache */
+        auto names = pick(iterations > 1000 ? 32 : 4096, false);
+        auto derive = check_ns(store, names, names.size());
+        auto cached = check_ns(store, names, 1000000);
+        std::printf("%10u | %10.1f %14.0f %14.1f %14.0f\n", iterations,
+            load, open, derive / 1000, cached);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <boost/asio.hpp>
+
+#include <src/riot/server/basic_server.hpp>
+
+using namespace riot::server;
+using namespace boost::asio;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const unsigned short port = 9873;
+
+/* the clients connect at once, send their headers and wait for the
+ * replies, then disconnect at once. returns the logins/s */
+double storm(std::size_t clients, std::size_t rounds) {
+    io_service ios;
+    std::vector<std::unique_ptr<ip::tcp::socket>> sockets;
+    std::vector<std::string> headers;
+    for (std::size_t i = 0; i < clients; ++i)
+        headers.push_back("RIOTp 1.0\nname: dev" + std::to_string(i) + "\ntype: bench\nEND\n");
+    std::size_t logins = 0;
+    auto start = clock_type::now();
+    for (std::size_t round = 0; round < rounds; ++round) {
+        for (std::size_t i = 0; i < clients; ++i) {
+            sockets.push_back(std::make_unique<ip::tcp::socket>(ios));
+            sockets.back()->connect(ip::tcp::endpoint(ip::address_v4::loopback(), port));
+            write(*sockets.back(), buffer(headers[i]));
+        }
+        for (auto &s: sockets) {
+            char reply[64];
+            std::size_t n = 0;
+            do
+                n += s->read_some(buffer(reply + n, sizeof(reply) - n));
+            while (reply[n - 1] != '\n');
+            logins += reply[0] == 'O';
+        }
+        sockets.clear();
+    }
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    return logins / elapsed.count();
+}
+
+}
+
+int main() {
+    /* a client and a server socket per connection */
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    std::size_t max_clients = limit.rlim_cur > 256 ? (limit.rlim_cur - 128) / 2 : 64;
+
+    std::printf("%12s %8s | %12s\n", "clients", "workers", "logins/s");
+    for (std::size_t workers: { 1, 4 }) {
+        io_service ios;
+        basic_server server(ios, port);
+        server.config.auth_threads = workers;
+        server.start();
+        std::unique_ptr<io_service::work> work(new io_service::work(ios));
+        std::thread thread([&ios] { ios.run(); });
+        for (std::size_t clients: { 1000, 10000 }) {
+            clients = std::min(clients, max_clients);
+            std::printf("%12zu %8zu | %12.0f\n", clients, workers, storm(clients, 3));
+        }
+        server.stop();
+        work.reset();
+        thread.join();
+    }
+    return 0;
+}
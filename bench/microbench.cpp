@@ -0,0 +1,214 @@
+/*
+ * microbenchmarks of the per-line path: header_parser, command_parser on each
+ * type of command, xeid_matcher and async_print. each case reports the time
+ * and the heap allocations per operation, the allocations are counted by
+ * replacing the global operator new. the parsers allocate from arenas as in
+ * async_stream_protocol.
+ */
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <src/riot/server/async_stream_protocol.hpp>
+#include <src/riot/server/command_parser.hpp>
+#include <src/riot/server/header_parser.hpp>
+#include <src/riot/server/xeid_matcher.hpp>
+
+namespace {
+
+/* single threaded, nothing here runs the io_service */
+std::uint64_t allocations = 0;
+
+}
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+using namespace riot::server;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+/* keeps the results alive */
+std::uint64_t sink = 0;
+
+/**
+ * @brief runs f, which does ops operations, for about 200 ms after a first
+ * call warming up the static and the thread local state, and prints the
+ * time and the allocations per operation.
+ */
+template <typename F>
+void measure(const std::string &name, std::size_t ops, F &&f) {
+    f();
+    std::uint64_t calls = 0;
+    auto allocated = allocations;
+    auto start = clock_type::now();
+    std::chrono::duration<double, std::nano> elapsed;
+    do {
+        for (int i = 0; i < 16; ++i)
+            f();
+        calls += 16;
+        elapsed = clock_type::now() - start;
+    } while (elapsed < std::chrono::milliseconds(200));
+    double n = static_cast<double>(calls * ops);
+    std::printf("%-56s %10.1f %10.2f\n", name.c_str(),
+        elapsed.count() / n, (allocations - allocated) / n);
+}
+
+const std::vector<std::string> header = {
+    "RIOTp 1.0",
+    "name: sensor_12 uniquify",
+    "type: thermometer",
+    "password: qwerty112358",
+    "name-policy: weak",
+    "timeout: 30min",
+    "END",
+};
+
+const std::vector<std::string> timeouts = {
+    "1500", "500ms", "30s", "5min", "1.5h", "2day", "1wk", "inf",
+};
+
+/* one line per type of command */
+const std::vector<std::string> commands = {
+    "trig temp@dashboard_1",
+    "trig hum@#dashboard temp@.*#dashboard",
+    "sub temp@sensor_.*#thermometer",
+    "sub temp@sensor_.*#thermometer hum@sensor_.*#hygrometer minperiod=500ms",
+    "unsub 1 2 3",
+    "negsub temp@sensor_13",
+    "unnegsub 4",
+    "pause",
+    "continue",
+    "p2p-accept maxconnections=16",
+    "p2p-stop-accept",
+    "p2p-disconnect 1 2",
+    "3>1024",
+    "1,2,3>n",
+    /* longer than the inline storage */
+    "trig temperature_reading@building_7_floor_3#thermometer",
+    "unsub 1 2 3 4 5 6 7 8 9 10 11 12",
+    "subscribe temp",
+    "unsub 1 two",
+};
+
+const std::vector<std::string> xeids = {
+    "temp",
+    "temp_.*",
+    "temp@sensor_12#thermometer",
+    "(temp|hum)_[0-9]*@sensor_.*#.*",
+};
+
+struct event {
+    std::string eid, dname, dtype;
+};
+
+const std::vector<event> events = {
+    { "temp", "sensor_12", "thermometer" },
+    { "temp_5", "dashboard_1", "dashboard" },
+    { "hum_42", "sensor_7", "hygrometer" },
+};
+
+/* a session writing nowhere, for the formatting of the replies */
+class null_session : public async_stream_protocol_base {
+public:
+    using async_stream_protocol_base::async_stream_protocol_base;
+
+    void async_write(buffer_ptr_type buf) override
+    { last_ = std::move(buf); }
+private:
+    buffer_ptr_type last_;
+};
+
+}
+
+int main() {
+    std::printf("%-56s %10s %10s\n", "case", "ns/op", "allocs/op");
+
+    measure("header_parser::feed_line (per line)", header.size(), [] {
+        std::array<std::byte, 256> storage;
+        std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size());
+        header_parser parser(&arena);
+        for (const auto &line: header)
+            sink += parser.feed_line(line);
+    });
+
+    measure("header_parser::string_to_timeout", timeouts.size(), [] {
+        bool has_timeout;
+        std::uint64_t timeout;
+        for (const auto &t: timeouts)
+            sink += header_parser::string_to_timeout(t, has_timeout, timeout);
+    });
+
+    std::array<std::byte, 256> storage;
+    std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size());
+    for (const auto &line: commands)
+        measure("command_parser::parse \"" + line.substr(0, 28) +
+            (line.size() > 28 ? "...\"" : "\""), 1, [&line, &arena] {
+            arena.release();
+            command_parser parser(&arena);
+            sink += parser.parse(line);
+        });
+
+    for (const auto &x: xeids)
+        measure("xeid_matcher::init \"" + x + "\"", 1, [&x] {
+            xeid_matcher m;
+            m.init(x);
+            sink += m.eid.size();
+        });
+
+    std::vector<xeid_matcher> matchers(xeids.begin(), xeids.end());
+    auto pairs = matchers.size() * events.size();
+    measure("xeid_matcher::matches", pairs, [&matchers] {
+        for (const auto &m: matchers)
+            for (const auto &e: events)
+                sink += m.matches(e.eid, e.dname, e.dtype);
+    });
+    measure("xeid_matcher::device_matches", pairs, [&matchers] {
+        for (const auto &m: matchers)
+            for (const auto &e: events)
+                sink += m.device_matches(e.dname, e.dtype);
+    });
+
+    io_service ios;
+    null_session session(ios);
+    std::string name = "sensor_12";
+    measure("async_stream_protocol_base::async_print (event)", 1, [&] {
+        session.async_print("EVENT ", events[0].eid, '@', name, '#', events[0].dtype, '\n');
+    });
+    measure("async_stream_protocol_base::async_println (reply)", 1, [&] {
+        session.async_println("OK ", sink % 1000);
+    });
+
+    std::fprintf(stderr, "%llu\n", static_cast<unsigned long long>(sink % 2));
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include <src/riot/server/basic_server.hpp>
+
+using namespace riot::server;
+using namespace boost::asio;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const unsigned short port = 9872;
+const auto duration = std::chrono::milliseconds(1000);
+
+ip::tcp::socket login(io_service &ios, const std::string &name, std::string &reply) {
+    ip::tcp::socket s(ios);
+    s.connect(ip::tcp::endpoint(ip::address_v4::loopback(), port));
+    write(s, buffer("RIOTp 1.0\nname: " + name + " enumerated\ntype: bench\nEND\n"));
+    streambuf b;
+    read_until(s, b, '\n');
+    reply.assign(buffers_begin(b.data()), buffers_end(b.data()));
+    return s;
+}
+
+/* reads the P2P pieces, counting the bytes forwarded */
+void receive(ip::tcp::socket &s, std::atomic<std::uint64_t> &received) {
+    std::vector<char> buf(1 << 20);
+    error_code ec;
+    streambuf header;
+    for (;;) {
+        auto n = read_until(s, header, '\n', ec);
+        if (ec)
+            return ;
+        std::string line(buffers_begin(header.data()), buffers_begin(header.data()) + n);
+        header.consume(n);
+        std::size_t size = std::strtoull(line.c_str() + line.rfind(' ') + 1, nullptr, 10);
+        std::size_t buffered = std::min(size, header.size());
+        header.consume(buffered);
+        for (std::size_t left = size - buffered; left > 0; ) {
+            auto m = s.read_some(buffer(buf.data(), std::min(left, buf.size())), ec);
+            if (ec)
+                return ;
+            left -= m;
+        }
+        received += size;
+    }
+}
+
+/* a sender sends blobs of the given size to the recipients, returns the
+ * MB/s received by each recipient */
+double megabytes_per_second(std::size_t recipients, std::size_t blob) {
+    io_service ios;
+    std::vector<ip::tcp::socket> peers;
+    std::string ids, reply;
+    for (std::size_t i = 0; i < recipients; ++i) {
+        peers.push_back(login(ios, "peer", reply));
+        write(peers.back(), buffer(std::string("p2p-accept\n")));
+        streambuf b;
+        auto n = read_until(peers.back(), b, '\n');
+        std::string ok(buffers_begin(b.data()), buffers_begin(b.data()) + n - 1);
+        ids += (ids.empty() ? "" : ",") + ok.substr(3);
+    }
+    std::atomic<std::uint64_t> received { 0 };
+    std::vector<std::thread> threads;
+    for (auto &s: peers)
+        threads.emplace_back([&s, &received] { receive(s, received); });
+    auto sender = login(ios, "sender", reply);
+    std::string command = ids + ">" + std::to_string(blob) + "\n";
+    std::vector<char> data(blob, 'x');
+    std::thread replies([&sender] {
+        char buf[4096];
+        error_code ec;
+        while (!ec)
+            sender.read_some(buffer(buf), ec);
+    });
+    std::uint64_t sent = 0;
+    auto start = clock_type::now();
+    while (clock_type::now() - start < duration) {
+        write(sender, std::vector<const_buffer> { buffer(command), buffer(data) });
+        sent += blob;
+    }
+    while (received < sent * recipients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    sender.shutdown(ip::tcp::socket::shutdown_both);
+    for (auto &s: peers)
+        s.shutdown(ip::tcp::socket::shutdown_both);
+    replies.join();
+    for (auto &t: threads)
+        t.join();
+    return sent / elapsed.count() / 1e6;
+}
+
+}
+
+int main() {
+    io_service ios;
+    basic_server server(ios, port);
+    server.start();
+    std::unique_ptr<io_service::work> work(new io_service::work(ios));
+    std::thread thread([&ios] { ios.run(); });
+    std::printf("%10s %10s | %12s %14s\n", "recipients", "blob", "MB/s", "MB/s total");
+    for (std::size_t recipients: { 1, 4 })
+        for (std::size_t blob: { 4096, 1 << 20, 16 << 20 }) {
+            auto rate = megabytes_per_second(recipients, blob);
+            std::printf("%10zu %10zu | %12.1f %14.1f\n",
+                recipients, blob, rate, rate * recipients);
+        }
+    server.stop();
+    work.reset();
+    thread.join();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <src/riot/server/payload.hpp>
+
+using namespace riot::server;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const std::string eid = "temperature", name = "sensor_4711", type = "thermometer";
+
+/* previous helpers: ostringstream, then a copy into a shared vector */
+std::shared_ptr<std::vector<char>> legacy_event(std::size_t &copied) {
+    std::ostringstream oss;
+    oss << "EVENT " << eid << "@" << name << "#" << type << "\n";
+    auto str = oss.str();
+    auto result = std::make_shared<std::vector<char>>(str.size());
+    std::copy(str.begin(), str.end(), result->begin());
+    copied += 2 * str.size();   /* into the stream and into the vector */
+    return result;
+}
+
+payload::ptr slab_event(std::size_t &copied) {
+    auto result = payload::format("EVENT ", eid, '@', name, '#', type, '\n');
+    copied += result->size();
+    return result;
+}
+
+/* delivers one event to every recipient queue, then drains the queues as
+ * the completed writes would, returns ns/event */
+template <typename Queue, typename F>
+double fan_out(std::vector<Queue> &queues, F &&make_event, bool per_recipient, std::size_t &copied) {
+    auto start = clock_type::now();
+    std::size_t events = 0;
+    copied = 0;
+    do {
+        if (per_recipient) {
+            for (auto &q: queues)
+                q.push_back(make_event(copied));
+        }
+        else {
+            auto event = make_event(copied);
+            for (auto &q: queues)
+                q.push_back(event);
+        }
+        for (auto &q: queues)
+            q.pop_front();
+        ++events;
+    } while (clock_type::now() - start < std::chrono::milliseconds(200));
+    std::chrono::duration<double, std::nano> elapsed = clock_type::now() - start;
+    copied /= events;
+    return elapsed.count() / events;
+}
+
+}
+
+int main() {
+    /* the server is multi-threaded, make sure shared_ptr doesn't take its
+     * single-threaded shortcut for the reference counts */
+    std::thread([] {}).join();
+    std::printf("%10s | %28s | %28s | %28s\n", "",
+        "copy per recipient", "shared vector", "shared slab");
+    std::printf("%10s | %14s %13s | %14s %13s | %14s %13s\n", "recipients",
+        "ns/event", "bytes/event", "ns/event", "bytes/event", "ns/event", "bytes/event");
+    for (std::size_t recipients: { 1, 10, 100, 1000, 10000 }) {
+        std::vector<std::deque<std::shared_ptr<std::vector<char>>>> legacy_queues(recipients);
+        std::vector<std::deque<payload::ptr>> slab_queues(recipients);
+        std::size_t copied_each, copied_shared, copied_slab;
+        double each = fan_out(legacy_queues, legacy_event, true, copied_each);
+        double shared = fan_out(legacy_queues, legacy_event, false, copied_shared);
+        double slab = fan_out(slab_queues, slab_event, false, copied_slab);
+        std::printf("%10zu | %14.0f %13zu | %14.0f %13zu | %14.0f %13zu\n",
+            recipients, each, copied_each, shared, copied_shared, slab, copied_slab);
+    }
+    return 0;
+}
@@ -0,0 +1,572 @@
+/*
+ * load generator: simulated devices log in over loopback, subscribe to
+ * groups of events, accept p2p transfers, then send a mix of trig, sub and
+ * p2p-send at a given rate. reports the throughput and the latencies:
+ *  - trig: from the trig line being written to each event being read by a
+ *    subscriber, the eid carries the time (g<group>_<ns>, subscribed as
+ *    g<group>_.*),
+ *  - sub: from the sub line to its OK (followed by an unsub),
+ *  - p2p: from the p2p-send line to the last of the data being read by the
+ *    recipient, the data begins with the time and its size, it may come in
+ *    several pieces.
+ *
+ * the server runs in the process (basic_server, or ssl_server_standalone
+ * with --tls), unless --external is given.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/resource.h>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/program_options.hpp>
+
+#include <src/riot/server/basic_server.hpp>
+#include <src/riot/server/ssl_server.hpp>
+#include <src/riot/server/metrics.hpp>
+
+using namespace riot::server;
+using namespace boost::asio;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+enum op_t { op_trig = 0, op_sub, op_p2p, op_count };
+
+const char *op_names[] = { "trig", "sub", "p2p" };
+
+struct options {
+    std::size_t devices;
+    std::size_t groups;
+    double rate;                /* ops/s per device */
+    double duration;            /* s */
+    unsigned weights[op_count];
+    std::size_t p2p_size;
+    std::size_t client_threads;
+    std::string host;
+    unsigned short port;
+};
+
+std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now().time_since_epoch()).count();
+}
+
+/* results of the devices of a client thread, merged at the end */
+struct thread_results {
+    std::uint64_t sent[op_count] {};
+    std::uint64_t completed[op_count] {};
+    std::uint64_t errors { 0 };
+    log_histogram latency[op_count];
+
+    void record(op_t op, std::uint64_t sent_ns) {
+        auto ns = now_ns() - sent_ns;
+        ++completed[op];
+        latency[op].add(log_histogram::bucket_of(ns), 1);
+        latency[op].add_sum(ns);
+    }
+};
+
+/* shared by the devices, written before the run starts */
+struct shared_run {
+    const options &opts;
+    std::vector<std::uint64_t> p2p_ids;
+    std::atomic<std::size_t> ready { 0 };
+    std::atomic<std::size_t> failed { 0 };
+    std::atomic<bool> running { false };
+};
+
+template <typename Stream>
+class device : public std::enable_shared_from_this<device<Stream>> {
+public:
+    template <typename ...Args>
+    device(std::size_t index, shared_run &run, thread_results &results,
+        io_service &ios, Args && ...stream_args) :
+        index_(index),
+        run_(run),
+        results_(results),
+        stream_(ios, stream_args...),
+        timer_(ios),
+        rng_(index) {
+    }
+
+    void start() {
+        auto self = this->shared_from_this();
+        ip::tcp::endpoint endpoint(ip::make_address(run_.opts.host), run_.opts.port);
+        lowest().async_connect(endpoint, [this, self](const boost::system::error_code &ec) {
+            if (ec)
+                return fail();
+            lowest().set_option(ip::tcp::no_delay(true));
+            handshake([this, self] {
+                send("RIOTp 1.0\nname: dev" + std::to_string(index_) +
+                    "\ntype: bench\nEND\n");
+                do_read();
+            });
+        });
+    }
+
+    /* starts sending, spread over the first period */
+    void run() {
+        std::uniform_real_distribution<double> first(0, 1 / run_.opts.rate);
+        schedule(std::chrono::duration_cast<clock_type::duration>(
+            std::chrono::duration<double>(first(rng_))));
+    }
+
+    void stop() {
+        timer_.cancel();
+    }
+private:
+    enum state_t { logging_in, subscribing, accepting, active };
+
+    std::size_t index_;
+    shared_run &run_;
+    thread_results &results_;
+    Stream stream_;
+    steady_timer timer_;
+    std::mt19937_64 rng_;
+    state_t state_ { logging_in };
+    boost::asio::streambuf read_buf_;
+    std::deque<std::string> write_queue_;
+    /* the commands waiting for their reply, with their sending time */
+    std::deque<std::pair<op_t, std::uint64_t>> pending_;
+    /* the p2p transfers being received, by sender */
+    struct p2p_transfer {
+        std::string start;
+        std::uint64_t sent_ns { 0 };
+        std::uint64_t size { 0 };
+        std::uint64_t received { 0 };
+    };
+    std::unordered_map<std::string, p2p_transfer> transfers_;
+
+    auto &lowest()
+    { return stream_.lowest_layer(); }
+
+    template <typename F>
+    void handshake(F &&then) {
+        if constexpr (std::is_same<Stream, ip::tcp::socket>::value)
+            then();
+        else
+            stream_.async_handshake(ssl::stream_base::client,
+                [this, then, self = this->shared_from_this()](const boost::system::error_code &ec) {
+                    if (ec)
+                        return fail();
+                    then();
+                });
+    }
+
+    void fail() {
+        if (state_ != active)
+            run_.failed.fetch_add(1);
+        state_ = active;
+        ++results_.errors;
+        boost::system::error_code ignored;
+        lowest().close(ignored);
+    }
+
+    void schedule(clock_type::duration delay) {
+        timer_.expires_after(delay);
+        timer_.async_wait([this, self = this->shared_from_this()](const boost::system::error_code &ec) {
+            if (ec || !run_.running.load(std::memory_order_relaxed))
+                return ;
+            send_op();
+            /* poisson arrivals */
+            std::exponential_distribution<double> gap(run_.opts.rate);
+            schedule(std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>(gap(rng_))));
+        });
+    }
+
+    op_t pick() {
+        const auto &w = run_.opts.weights;
+        std::uniform_int_distribution<unsigned> d(0, w[op_trig] + w[op_sub] + w[op_p2p] - 1);
+        auto r = d(rng_);
+        if (r < w[op_trig])
+            return op_trig;
+        return r < w[op_trig] + w[op_sub] ? op_sub : op_p2p;
+    }
+
+    void send_op() {
+        const auto &opts = run_.opts;
+        auto op = pick();
+        auto t = now_ns();
+        ++results_.sent[op];
+        switch (op) {
+        case op_trig: {
+            std::uniform_int_distribution<std::size_t> group(0, opts.groups - 1);
+            send("trig g" + std::to_string(group(rng_)) + "_" + std::to_string(t) + "\n");
+            break;
+        }
+        case op_sub: {
+            pending_.emplace_back(op_sub, t);
+            send("sub z" + std::to_string(index_) + "_.*\n");
+            break;
+        }
+        case op_p2p: {
+            /* to a few neighbours, so the links stay bounded */
+            std::uniform_int_distribution<std::size_t> peer(1, std::min<std::size_t>(4, opts.devices - 1));
+            auto id = run_.p2p_ids[(index_ + peer(rng_)) % opts.devices];
+            auto data = std::to_string(t) + " ";
+            auto size = std::max(opts.p2p_size, data.size() + 21);
+            data += std::to_string(size) + " ";
+            data.resize(size, 'x');
+            pending_.emplace_back(op_p2p, t);
+            send(std::to_string(id) + ">" + std::to_string(data.size()) + "\n" + data);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void send(std::string data) {
+        write_queue_.push_back(std::move(data));
+        if (write_queue_.size() == 1)
+            do_write();
+    }
+
+    void do_write() {
+        async_write(stream_, buffer(write_queue_.front()),
+            [this, self = this->shared_from_this()](const boost::system::error_code &ec, std::size_t) {
+                if (ec)
+                    return ;
+                write_queue_.pop_front();
+                if (!write_queue_.empty())
+                    do_write();
+            });
+    }
+
+    void do_read() {
+        async_read_until(stream_, read_buf_, '\n',
+            [this, self = this->shared_from_this()](const boost::system::error_code &ec, std::size_t n) {
+                if (ec) {
+                    if (state_ != active)
+                        fail();
+                    return ;
+                }
+                std::string line(buffers_begin(read_buf_.data()), buffers_begin(read_buf_.data()) + n - 1);
+                read_buf_.consume(n);
+                handle_line(line);
+            });
+    }
+
+    void handle_line(const std::string &line) {
+        if (line.compare(0, 4, "P2P ") == 0) {
+            /* P2P <sender> <size>, then the data */
+            auto space = line.rfind(' ');
+            read_p2p(line.substr(4, space - 4), std::stoull(line.substr(space + 1)));
+            return ;
+        }
+        if (line.compare(0, 6, "EVENT ") == 0)
+            handle_event(line);
+        else if (line.compare(0, 2, "OK") == 0 || line.compare(0, 5, "ERROR") == 0)
+            handle_reply(line);
+        /* PAUSE and CONTINUE are only informative */
+        do_read();
+    }
+
+    void handle_event(const std::string &line) {
+        /* EVENT g<group>_<ns>@... */
+        auto underscore = line.find('_');
+        auto at = line.find('@');
+        if (underscore != std::string::npos && at != std::string::npos)
+            results_.record(op_trig, std::stoull(line.substr(underscore + 1, at - underscore - 1)));
+    }
+
+    void handle_reply(const std::string &line) {
+        bool ok = line[0] == 'O';
+        switch (state_) {
+        case logging_in:
+            if (!ok)
+                return fail();
+            state_ = subscribing;
+            send("sub g" + std::to_string(index_ % run_.opts.groups) + "_.*\n");
+            return ;
+        case subscribing:
+            if (!ok)
+                return fail();
+            state_ = accepting;
+            send("p2p-accept maxconnections=" + std::to_string(run_.opts.devices) + "\n");
+            return ;
+        case accepting:
+            if (!ok)
+                return fail();
+            state_ = active;
+            run_.p2p_ids[index_] = std::stoull(line.substr(3));
+            run_.ready.fetch_add(1);
+            return ;
+        case active:
+            break;
+        }
+        /* the replies come in the order of the commands */
+        if (pending_.empty())
+            return ;
+        auto p = pending_.front();
+        pending_.pop_front();
+        if (!ok) {
+            ++results_.errors;
+            return ;
+        }
+        if (p.first == op_sub) {
+            results_.record(op_sub, p.second);
+            /* OK <subID>, op_count stands for the unsub */
+            pending_.emplace_back(op_count, 0);
+            send("unsub " + line.substr(3) + "\n");
+        }
+        /* the latency of p2p is taken by the recipient */
+    }
+
+    void read_p2p(std::string sender, std::size_t size) {
+        auto available = read_buf_.size();
+        if (available >= size) {
+            auto begin = buffers_begin(read_buf_.data());
+            auto &transfer = transfers_[sender];
+            if (transfer.size == 0) {
+                /* "<ns> <size> " at the beginning, maybe split over pieces */
+                transfer.start.append(begin, begin + std::min<std::size_t>(size, 48));
+                auto first = transfer.start.find(' ');
+                auto second = transfer.start.find(' ', first + 1);
+                if (second != std::string::npos) {
+                    transfer.sent_ns = std::stoull(transfer.start.substr(0, first));
+                    transfer.size = std::stoull(transfer.start.substr(first + 1, second - first - 1));
+                    transfer.start.clear();
+                }
+            }
+            read_buf_.consume(size);
+            transfer.received += size;
+            if (transfer.size && transfer.received >= transfer.size) {
+                results_.record(op_p2p, transfer.sent_ns);
+                transfer = p2p_transfer();
+            }
+            do_read();
+            return ;
+        }
+        async_read(stream_, read_buf_, transfer_exactly(size - available),
+            [this, sender = std::move(sender), size, self = this->shared_from_this()]
+            (const boost::system::error_code &ec, std::size_t) mutable {
+                if (ec)
+                    return ;
+                read_p2p(std::move(sender), size);
+            });
+    }
+};
+
+/* runs the devices on client threads, returns false if they couldn't all
+ * log in */
+template <typename Stream, typename ...Args>
+bool drive(const options &opts, Args && ...stream_args) {
+    shared_run run { opts, std::vector<std::uint64_t>(opts.devices), { 0 }, { 0 }, { false } };
+    std::vector<std::unique_ptr<io_service>> services;
+    std::vector<std::unique_ptr<io_service::work>> works;
+    std::vector<thread_results> results(opts.client_threads);
+    std::vector<std::vector<std::shared_ptr<device<Stream>>>> devices(opts.client_threads);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < opts.client_threads; ++t) {
+        services.push_back(std::make_unique<io_service>(1));
+        works.push_back(std::make_unique<io_service::work>(*services.back()));
+    }
+    for (std::size_t t = 0; t < opts.client_threads; ++t)
+        threads.emplace_back([&services, t] { services[t]->run(); });
+
+    auto setup_start = clock_type::now();
+    const std::size_t wave = 256;   /* within the listen backlog */
+    for (std::size_t i = 0; i < opts.devices; ++i) {
+        auto t = i % opts.client_threads;
+        auto d = std::make_shared<device<Stream>>(i, run, results[t], *services[t], stream_args...);
+        devices[t].push_back(d);
+        post(*services[t], [d] { d->start(); });
+        if ((i + 1) % wave == 0)
+            while (run.ready.load() + run.failed.load() + wave / 2 < i + 1)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    while (run.ready.load() + run.failed.load() < opts.devices &&
+           clock_type::now() - setup_start < std::chrono::seconds(60))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::chrono::duration<double> setup = clock_type::now() - setup_start;
+    std::printf("setup: %zu devices ready in %.2f s, %zu failed\n",
+        run.ready.load(), setup.count(), run.failed.load());
+    bool fine = run.ready.load() == opts.devices;
+
+    if (fine) {
+        run.running.store(true);
+        for (std::size_t t = 0; t < opts.client_threads; ++t)
+            post(*services[t], [&devices, t] {
+                for (auto &d: devices[t])
+                    d->run();
+            });
+        std::this_thread::sleep_for(std::chrono::duration<double>(opts.duration));
+        run.running.store(false);
+        for (std::size_t t = 0; t < opts.client_threads; ++t)
+            post(*services[t], [&devices, t] {
+                for (auto &d: devices[t])
+                    d->stop();
+            });
+        /* the last replies and events */
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    for (auto &s: services)
+        s->stop();
+    for (auto &t: threads)
+        t.join();
+    devices.clear();
+
+    if (!fine)
+        return false;
+    thread_results total;
+    for (auto &r: results) {
+        for (std::size_t op = 0; op < op_count; ++op) {
+            total.sent[op] += r.sent[op];
+            total.completed[op] += r.completed[op];
+            total.latency[op].merge(r.latency[op]);
+        }
+        total.errors += r.errors;
+    }
+    /* a trig is received by each subscriber of its group */
+    std::printf("%6s | %10s %10s %12s | %10s %10s %10s\n",
+        "op", "sent", "received", "received/s", "p50 us", "p99 us", "p999 us");
+    for (std::size_t op = 0; op < op_count; ++op) {
+        const auto &h = total.latency[op];
+        std::printf("%6s | %10llu %10llu %12.0f | %10.1f %10.1f %10.1f\n",
+            op_names[op],
+            static_cast<unsigned long long>(total.sent[op]),
+            static_cast<unsigned long long>(total.completed[op]),
+            total.completed[op] / opts.duration,
+            h.quantile(0.5) / 1e3, h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3);
+    }
+    std::printf("errors: %llu\n", static_cast<unsigned long long>(total.errors));
+    return true;
+}
+
+/* trig=80,sub=10,p2p=10 */
+bool parse_mix(const std::string &mix, unsigned weights[op_count]) {
+    std::fill(weights, weights + op_count, 0);
+    std::size_t pos = 0;
+    while (pos < mix.size()) {
+        auto end = mix.find(',', pos);
+        if (end == std::string::npos)
+            end = mix.size();
+        auto item = mix.substr(pos, end - pos);
+        auto eq = item.find('=');
+        if (eq == std::string::npos)
+            return false;
+        auto name = item.substr(0, eq);
+        auto it = std::find(std::begin(op_names), std::end(op_names), name);
+        if (it == std::end(op_names))
+            return false;
+        weights[it - std::begin(op_names)] = std::stoul(item.substr(eq + 1));
+        pos = end + 1;
+    }
+    return weights[op_trig] + weights[op_sub] + weights[op_p2p] > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    namespace po = boost::program_options;
+    options opts;
+    std::string mix, cert_dir;
+    std::size_t server_threads;
+    po::options_description desc("riot_bench options");
+    desc.add_options()
+        ("help,h", "print this message")
+        ("tls", "connect over tls")
+        ("devices,n", po::value(&opts.devices)->default_value(1000), "number of the simulated devices")
+        ("groups", po::value(&opts.groups)->default_value(0),
+            "number of the event groups, each device subscribes to one, "
+            "0 for devices / 10")
+        ("rate,r", po::value(&opts.rate)->default_value(10), "operations per second of each device")
+        ("duration,d", po::value(&opts.duration)->default_value(5), "seconds of sending")
+        ("mix,m", po::value(&mix)->default_value("trig=80,sub=10,p2p=10"),
+            "weights of the operations")
+        ("p2p-size", po::value(&opts.p2p_size)->default_value(1024), "bytes per p2p-send")
+        ("client-threads", po::value(&opts.client_threads)->default_value(2),
+            "threads running the devices")
+        ("server-threads", po::value(&server_threads)->default_value(2),
+            "threads running the server in the process")
+        ("external", "don't run a server, connect to --host and --port")
+        ("host", po::value(&opts.host)->default_value("127.0.0.1"), "address of the server")
+        ("port,p", po::value(&opts.port)->default_value(9875), "port of the server")
+        ("cert-dir", po::value(&cert_dir)->default_value("../ssl"),
+            "directory of cert.pem and key.pem, for the server in the process");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch (const po::error &e) {
+        std::cerr << e.what() << "\n" << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    if (!parse_mix(mix, opts.weights) || opts.devices < 2 || opts.rate <= 0 ||
+        opts.client_threads == 0) {
+        std::cerr << "invalid options\n" << desc << std::endl;
+        return 1;
+    }
+    if (opts.groups == 0)
+        opts.groups = std::max<std::size_t>(1, opts.devices / 10);
+    bool tls = vm.count("tls");
+    bool external = vm.count("external");
+
+    /* a client and a server socket per device */
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    std::printf("%zu devices over %s, %zu groups, %.0f ops/s each for %.0f s, mix %s\n",
+        opts.devices, tls ? "tls" : "tcp", opts.groups, opts.rate, opts.duration, mix.c_str());
+
+    io_service server_service;
+    std::unique_ptr<io_service::work> work(new io_service::work(server_service));
+    ssl::context server_ctx(ssl::context::sslv23);
+    std::unique_ptr<basic_server> plain_server;
+    std::unique_ptr<ssl_server_standalone> ssl_server;
+    std::vector<std::thread> server_workers;
+    if (!external) {
+        if (tls) {
+            server_ctx.set_password_callback(
+                [](std::size_t, ssl::context::password_purpose) -> std::string
+                { return "qwerty112358"; });
+            server_ctx.use_certificate_file(cert_dir + "/cert.pem", ssl::context::pem);
+            server_ctx.use_private_key_file(cert_dir + "/key.pem", ssl::context::pem);
+            ssl_server = std::make_unique<ssl_server_standalone>(server_service, server_ctx, opts.port);
+            ssl_server->start();
+        }
+        else {
+            plain_server = std::make_unique<basic_server>(server_service, opts.port);
+            plain_server->start();
+        }
+        for (std::size_t i = 0; i < std::max<std::size_t>(1, server_threads); ++i)
+            server_workers.emplace_back([&server_service] { server_service.run(); });
+    }
+
+    bool fine;
+    if (tls) {
+        ssl::context client_ctx(ssl::context::sslv23);
+        fine = drive<ssl::stream<ip::tcp::socket>>(opts, client_ctx);
+    }
+    else
+        fine = drive<ip::tcp::socket>(opts);
+
+    if (plain_server)
+        plain_server->stop();
+    if (ssl_server)
+        ssl_server->stop();
+    /* runs out once the sessions are closed */
+    work.reset();
+    for (auto &t: server_workers)
+        t.join();
+    return fine ? 0 : 1;
+}
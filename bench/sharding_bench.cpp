@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include <src/riot/server/basic_server.hpp>
+#include <src/riot/server/server_pool.hpp>
+
+using namespace riot::server;
+using namespace boost::asio;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const unsigned short port = 9871;
+const auto duration = std::chrono::milliseconds(1000);
+
+/* the current layout: one io_service run by all the threads */
+class single_layout {
+public:
+    explicit single_layout(std::size_t threads) :
+        work_(std::make_unique<io_service::work>(io_service_)),
+        server_(io_service_, port) {
+        server_.start();
+        for (std::size_t i = 0; i < threads; ++i)
+            threads_.emplace_back([this] { io_service_.run(); });
+    }
+
+    ~single_layout() {
+        server_.stop();
+        work_.reset();  /* returns once the sessions are closed */
+        for (auto &t: threads_)
+            t.join();
+    }
+private:
+    io_service io_service_;
+    std::unique_ptr<io_service::work> work_;
+    basic_server server_;
+    std::list<std::thread> threads_;
+};
+
+/* an io_service per thread, pinned, with SO_REUSEPORT acceptors */
+class sharded_layout {
+public:
+    explicit sharded_layout(std::size_t threads) :
+        pool_(threads, port) {
+        pool_.start();
+    }
+private:
+    server_pool<basic_server> pool_;
+};
+
+ip::tcp::socket login(io_service &ios, const std::string &name) {
+    ip::tcp::socket s(ios);
+    s.connect(ip::tcp::endpoint(ip::address_v4::loopback(), port));
+    s.set_option(ip::tcp::no_delay(true));
+    write(s, buffer("RIOTp 1.0\nname: " + name + " enumerated\ntype: bench\nEND\n"));
+    streambuf reply;
+    read_until(s, reply, '\n');
+    return s;
+}
+
+/* clients connect, log in and disconnect in a loop */
+double connections_per_second(std::size_t clients) {
+    std::atomic<std::size_t> done { 0 };
+    std::vector<std::thread> threads;
+    auto start = clock_type::now();
+    for (std::size_t i = 0; i < clients; ++i)
+        threads.emplace_back([&done, start] {
+            io_service ios;
+            while (clock_type::now() - start < duration) {
+                login(ios, "conn");
+                ++done;
+            }
+        });
+    for (auto &t: threads)
+        t.join();
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    return done / elapsed.count();
+}
+
+/* every subscriber subscribes to all the events of the publishers, which
+ * trigger in batches while the events in flight are below a window */
+double triggers_per_second(std::size_t publishers, std::size_t subscribers) {
+    const std::size_t batch = 64, window = 4096;
+    std::atomic<std::size_t> sent { 0 }, received { 0 };
+    std::atomic<bool> running { true };
+    io_service ios;
+    std::vector<ip::tcp::socket> subs;
+    for (std::size_t i = 0; i < subscribers; ++i) {
+        subs.push_back(login(ios, "sub"));
+        write(subs.back(), buffer(std::string("sub e\n")));
+        streambuf reply;
+        read_until(subs.back(), reply, '\n');
+    }
+    std::vector<std::thread> threads;
+    for (auto &s: subs)
+        threads.emplace_back([&s, &received, &running] {
+            char buf[65536];
+            error_code ec;
+            while (running) {
+                auto n = s.read_some(buffer(buf), ec);
+                if (ec)
+                    return ;
+                std::size_t lines = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    lines += buf[i] == '\n';
+                received += lines;
+            }
+        });
+    std::string lines;
+    for (std::size_t i = 0; i < batch; ++i)
+        lines += "trig e\n";
+    auto start = clock_type::now();
+    std::vector<std::thread> pubs;
+    for (std::size_t i = 0; i < publishers; ++i)
+        pubs.emplace_back([&, start] {
+            io_service ios;
+            auto s = login(ios, "pub");
+            while (clock_type::now() - start < duration) {
+                while (sent * subscribers > received + window)
+                    std::this_thread::yield();
+                write(s, buffer(lines));
+                sent += batch;
+            }
+        });
+    for (auto &t: pubs)
+        t.join();
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    double result = received / elapsed.count();
+    running = false;
+    for (auto &s: subs)
+        s.shutdown(ip::tcp::socket::shutdown_both);
+    for (auto &t: threads)
+        t.join();
+    return result;
+}
+
+template <typename Layout>
+void run(const char *name, std::size_t threads) {
+    double conns, trigs;
+    {
+        Layout layout(threads);
+        conns = connections_per_second(4);
+    }
+    {
+        Layout layout(threads);
+        trigs = triggers_per_second(4, 16);
+    }
+    std::printf("%10s %8zu | %12.0f %14.0f\n", name, threads, conns, trigs);
+}
+
+}
+
+int main() {
+    std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%10s %8s | %12s %14s\n", "layout", "threads", "conns/s", "events/s");
+    std::vector<std::size_t> thread_counts { 1, 4 };
+    if (cores != 1 && cores != 4)
+        thread_counts.push_back(cores);
+    for (auto threads: thread_counts) {
+        run<single_layout>("single", threads);
+        run<sharded_layout>("sharded", threads);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <src/riot/server/subscription_index.hpp>
+#include <src/riot/server/xeid_matcher.hpp>
+
+using namespace riot::server;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+struct event {
+    std::string eid, dname, dtype;
+};
+
+/* a mix resembling a sensor network: mostly exact eids, some prefixes, some
+ * device subscriptions, a few irregular patterns */
+std::string make_pattern(std::size_t i, std::mt19937 &rng) {
+    auto k = std::to_string(rng() % 1000);
+    switch (i % 20) {
+    case 0: case 1: case 2:
+        return "sensor_" + k.substr(0, 2) + ".*";
+    case 3: case 4: case 5:
+        return ".*@dev_" + k;
+    case 6:
+        return "(temp|hum)_" + k + "[0-9]*";
+    default:
+        return "temp_" + k;
+    }
+}
+
+event make_event(std::mt19937 &rng) {
+    auto k = std::to_string(rng() % 1000);
+    if (rng() % 2)
+        return { "temp_" + k, "dev_" + std::to_string(rng() % 1000), "sensor" };
+    return { "sensor_" + k, "dev_" + std::to_string(rng() % 1000), "sensor" };
+}
+
+template <typename F>
+double triggers_per_second(const std::vector<event> &events, F &&f, std::size_t &matches) {
+    auto start = clock_type::now();
+    std::size_t n = 0;
+    matches = 0;
+    do {
+        for (const auto &e: events)
+            matches += f(e);
+        n += events.size();
+    } while (clock_type::now() - start < std::chrono::milliseconds(300));
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    matches /= n;
+    return n / elapsed.count();
+}
+
+}
+
+int main() {
+    std::printf("%12s %16s %16s %12s\n",
+        "subscribers", "index trig/s", "linear trig/s", "matches/trig");
+    for (std::size_t subscribers: { 100, 1000, 10000, 100000 }) {
+        std::mt19937 rng(42);
+        subscription_index<std::size_t> index;
+        std::vector<xeid_matcher> linear;
+        for (std::size_t i = 0; i < subscribers; ++i) {
+            xeid_matcher xeidm(make_pattern(i, rng));
+            linear.push_back(xeidm);
+            index.subscribe(i, 1, std::move(xeidm));
+        }
+        std::vector<event> events;
+        for (int i = 0; i < 64; ++i)
+            events.push_back(make_event(rng));
+
+        std::size_t index_matches, linear_matches;
+        double index_rate = triggers_per_second(events, [&](const event &e) {
+            std::size_t n = 0;
+            index.route(e.eid, e.dname, e.dtype, [&](std::size_t, std::uint64_t, std::uint64_t) {
+                ++n;
+            });
+            return n;
+        }, index_matches);
+        double linear_rate = triggers_per_second(events, [&](const event &e) {
+            std::size_t n = 0;
+            for (const auto &xeidm: linear)
+                n += xeidm.matches(e.eid, e.dname, e.dtype);
+            return n;
+        }, linear_matches);
+        if (index_matches != linear_matches) {
+            std::fprintf(stderr, "mismatch: %zu != %zu\n", index_matches, linear_matches);
+            return 1;
+        }
+        std::printf("%12zu %16.0f %16.0f %12zu\n",
+            subscribers, index_rate, linear_rate, index_matches);
+    }
+    return 0;
+}
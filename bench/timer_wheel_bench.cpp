@@ -0,0 +1,139 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <src/riot/server/timer_wheel.hpp>
+
+using namespace riot::server;
+using namespace boost::asio;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const auto timeout = std::chrono::minutes(30);
+
+struct session {
+    explicit session(io_service &ios) :
+        timer(ios)
+    {}
+
+    steady_timer timer;                     /* per-connection timer */
+    std::atomic<std::uint64_t> last { 0 };  /* last activity, for the wheel */
+    std::uint64_t idle_ticks { 0 };
+    std::size_t expired { 0 };
+};
+
+using session_ptr = std::shared_ptr<session>;
+
+std::vector<session_ptr> make_sessions(io_service &ios, std::size_t n) {
+    std::vector<session_ptr> result;
+    for (std::size_t i = 0; i < n; ++i)
+        result.push_back(std::make_shared<session>(ios));
+    return result;
+}
+
+/* a read re-arms the timer of the session, cancelling the pending wait */
+double asio_touches(std::size_t n) {
+    io_service ios;
+    auto sessions = make_sessions(ios, n);
+    std::mt19937 rng(1);
+    std::size_t touches = 0;
+    auto start = clock_type::now();
+    do {
+        for (int i = 0; i < 1024; ++i) {
+            auto &s = *sessions[rng() % n];
+            s.timer.expires_after(timeout);
+            s.timer.async_wait([&s](const boost::system::error_code &ec) {
+                if (!ec)
+                    ++s.expired;
+            });
+        }
+        touches += 1024;
+        ios.poll();
+    } while (clock_type::now() - start < std::chrono::milliseconds(300));
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    for (auto &s: sessions)
+        s->timer.cancel();
+    ios.poll();
+    return touches / elapsed.count();
+}
+
+/* a read records the current tick of the wheel */
+double wheel_touches(std::size_t n) {
+    io_service ios;
+    auto sessions = make_sessions(ios, n);
+    timer_wheel<session> wheel(ios, [](const session_ptr &s, std::uint64_t now) {
+        auto deadline = s->last.load(std::memory_order_relaxed) + s->idle_ticks;
+        return deadline > now ? deadline : 0;
+    });
+    wheel.start(std::chrono::milliseconds(1));
+    ios.poll();
+    for (auto &s: sessions) {
+        s->idle_ticks = wheel.ticks(timeout);
+        wheel.schedule(s, wheel.now() + s->idle_ticks);
+    }
+    std::mt19937 rng(1);
+    std::size_t touches = 0;
+    auto start = clock_type::now();
+    do {
+        for (int i = 0; i < 1024; ++i)
+            sessions[rng() % n]->last.store(wheel.now(), std::memory_order_relaxed);
+        touches += 1024;
+        ios.poll();     /* lets the wheel tick */
+    } while (clock_type::now() - start < std::chrono::milliseconds(300));
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    wheel.stop();
+    ios.poll();
+    return touches / elapsed.count();
+}
+
+/* n sessions expire at once */
+double asio_expiries(std::size_t n) {
+    io_service ios;
+    auto sessions = make_sessions(ios, n);
+    auto start = clock_type::now();
+    for (auto &s: sessions) {
+        s->timer.expires_after(std::chrono::seconds(0));
+        s->timer.async_wait([&s = *s](const boost::system::error_code &ec) {
+            if (!ec)
+                ++s.expired;
+        });
+    }
+    ios.run();
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    return n / elapsed.count();
+}
+
+double wheel_expiries(std::size_t n) {
+    io_service ios;
+    auto sessions = make_sessions(ios, n);
+    timer_wheel<session> wheel(ios, [](const session_ptr &s, std::uint64_t) {
+        ++s->expired;
+        return std::uint64_t(0);
+    });
+    auto start = clock_type::now();
+    for (auto &s: sessions)
+        wheel.schedule(s, 1);
+    wheel.tick();
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    return n / elapsed.count();
+}
+
+}
+
+int main() {
+    std::printf("%10s | %26s | %26s\n", "", "re-arms/s", "expiries/s");
+    std::printf("%10s | %12s %13s | %12s %13s\n", "sessions",
+        "asio timers", "timer wheel", "asio timers", "timer wheel");
+    for (std::size_t n: { 1000, 10000, 100000 }) {
+        std::printf("%10zu | %12.0f %13.0f | %12.0f %13.0f\n", n,
+            asio_touches(n), wheel_touches(n), asio_expiries(n), wheel_expiries(n));
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <src/riot/server/ssl_server.hpp>
+
+using namespace riot::server;
+using namespace boost::asio;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+const unsigned short port = 9874;
+
+/* connects, logs in and disconnects without close_notify, like the
+ * devices. returns the connections/s */
+double reconnect(std::size_t connections, bool resume) {
+    io_service ios;
+    ssl::context ctx(ssl::context::sslv23);
+    SSL_SESSION *session = nullptr;
+    auto start = clock_type::now();
+    for (std::size_t i = 0; i < connections; ++i) {
+        ssl::stream<ip::tcp::socket> s(ios, ctx);
+        s.lowest_layer().connect(ip::tcp::endpoint(ip::address_v4::loopback(), port));
+        s.lowest_layer().set_option(ip::tcp::no_delay(true));
+        if (session)
+            SSL_set_session(s.native_handle(), session);
+        s.handshake(ssl::stream_base::client);
+        write(s, buffer("RIOTp 1.0\nname: dev" + std::to_string(i) + "\ntype: bench\nEND\n"));
+        /* the tls 1.3 tickets come with the reply */
+        char reply[64];
+        std::size_t n = 0;
+        do
+            n += s.read_some(buffer(reply + n, sizeof(reply) - n));
+        while (reply[n - 1] != '\n');
+        if (resume) {
+            if (session)
+                SSL_SESSION_free(session);
+            session = SSL_get1_session(s.native_handle());
+        }
+        /* keeps the session resumable, see ssl_server_standalone::connection */
+        SSL_set_shutdown(s.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        s.lowest_layer().close();
+    }
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    if (session)
+        SSL_SESSION_free(session);
+    return connections / elapsed.count();
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::string dir = argc > 1 ? argv[1] : "../ssl";
+    struct mode {
+        const char *name;
+        bool resume;
+        bool tickets;
+        std::size_t cache_size;
+    };
+    std::printf("%10s | %14s %10s %10s\n", "resumption", "handshakes/s", "full", "resumed");
+    for (auto m: { mode { "none", false, true, 20480 },
+                   mode { "tickets", true, true, 0 },
+                   mode { "cache", true, false, 20480 } }) {
+        io_service ios;
+        ssl::context sslctx(ssl::context::sslv23);
+        sslctx.set_password_callback(
+            [](std::size_t, ssl::context::password_purpose) -> std::string
+            { return "qwerty112358"; });
+        sslctx.use_certificate_file(dir + "/cert.pem", ssl::context::pem);
+        sslctx.use_private_key_file(dir + "/key.pem", ssl::context::pem);
+        ssl_server_standalone server(ios, sslctx, port);
+        server.config.tls_tickets = m.tickets;
+        server.config.tls_resume_unclean = true;    /* see reconnect() */
+        server.config.tls_session_cache_size = m.cache_size;
+        server.start();
+        std::unique_ptr<io_service::work> work(new io_service::work(ios));
+        std::thread thread([&ios] { ios.run(); });
+        auto rate = reconnect(m.resume ? 2000 : 200, m.resume);
+        std::printf("%10s | %14.0f %10llu %10llu\n", m.name, rate,
+            static_cast<unsigned long long>(server.metrics.total(metrics_registry::handshakes_full)),
+            static_cast<unsigned long long>(server.metrics.total(metrics_registry::handshakes_resumed)));
+        server.stop();
+        work.reset();
+        thread.join();
+    }
+    return 0;
+}
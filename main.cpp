@@ -2,46 +2,51 @@
 #include <thread>
 #include <string>
 #include <locale>
+#include <iostream>
+#include <memory>
+#include <csignal>
+#include <boost/program_options.hpp>
 
 #include <src/riot/server/basic_server.hpp>
 #include <src/riot/server/ssl_server.hpp>
+#include <src/riot/server/server_pool.hpp>
+#include <src/riot/server/credential_store.hpp>
+#include <src/riot/server/admin_server.hpp>
 
-int main(int argc, char **argv) {
-#if 0
-    using namespace riot::server;
-    boost::asio::io_service io_service;
-    boost::asio::io_service::work work(io_service); // ensure threads work
-    basic_server server(io_service, 9990);
-    std::list<std::thread> threads;
-    for (int i = 0; i < 2; ++i) {
-        threads.emplace_back([&io_service]() {
-            io_service.run();
-        });
-    }
-    server.start();
-    io_service.run();
-    return 0;
-#endif
-    
-#if 1
-    std::locale::global(std::locale("en_US.UTF-8"));
-    using namespace riot::server;
-    using namespace boost::asio;
+using namespace riot::server;
+using namespace boost::asio;
+
+/* where the metrics are served, port 0 for nowhere */
+struct admin_endpoint {
+    std::string address;
+    unsigned short port;
+};
+
+std::unique_ptr<admin_server> serve_admin(
+    io_service &io_serv,
+    const admin_endpoint &admin,
+    const metrics_registry &metrics) {
+    if (admin.port == 0)
+        return nullptr;
+    auto server = std::make_unique<admin_server>(io_serv, admin.address, admin.port, metrics);
+    server->start();
+    return server;
+}
+
+/* single io_service, run by all the threads */
+template <typename Server, typename ...Args>
+void run_single(
+    std::size_t threads,
+    const server_configuration &config,
+    const admin_endpoint &admin,
+    Args && ...args) {
     io_service io_serv;
-    ssl::context sslctx(io_serv, ssl::context::sslv23);
-    sslctx.set_options(
-        ssl::context::default_workarounds |
-        ssl::context::no_sslv2);
-    sslctx.set_password_callback(
-        [](std::size_t max_length, ssl::context::password_purpose purpose)
-        -> std::string
-        { return "qwerty112358"; });
-    sslctx.use_certificate_file("../ssl/cert.pem", ssl::context::pem);
-    sslctx.use_private_key_file("../ssl/key.pem", ssl::context::pem);
-    ssl_server_standalone server(io_serv, sslctx, 9990);
-    std::list<std::thread> threads;
-    for (int i = 0; i < 3; ++i)
-        threads.emplace_back([&io_serv, i]() {
+    Server server(io_serv, args...);
+    server.config = config;
+    auto admin_srv = serve_admin(io_serv, admin, server.metrics);
+    std::list<std::thread> workers;
+    for (std::size_t i = 1; i < threads; ++i)
+        workers.emplace_back([&io_serv, i]() {
             io_service::work work(io_serv);
             std::cout << "thread start: " + std::to_string(i) + "\n";
             io_serv.run();
@@ -50,8 +55,156 @@ int main(int argc, char **argv) {
     server.start();
     io_service::work work(io_serv);
     io_serv.run();
-    for (auto &t: threads) t.join();
+    for (auto &t: workers) t.join();
+}
+
+/* an io_service per thread, see server_pool */
+template <typename Server, typename ...Args>
+void run_sharded(
+    std::size_t threads,
+    const server_configuration &config,
+    const admin_endpoint &admin,
+    Args && ...args) {
+    server_pool<Server> pool(threads, args...);
+    pool.shared().config = config;
+    auto admin_srv = serve_admin(pool.service(0), admin, pool.shared().metrics);
+    std::cout << "shards: " + std::to_string(pool.size()) + "\n";
+    pool.start();
+    pool.join();
+}
+
+int main(int argc, char **argv) {
+    namespace po = boost::program_options;
+    std::string mode, cert, key, credentials_file;
+    server_configuration config;
+    admin_endpoint admin;
+    std::size_t threads;
+    unsigned short port;
+    po::options_description desc("riotserver3 options");
+    desc.add_options()
+        ("help,h", "print this message")
+        ("plain", "serve plain tcp instead of ssl")
+        ("port,p", po::value(&port)->default_value(9990), "port to listen on")
+        ("mode,m", po::value(&mode)->default_value("single"),
+            "single: one io_service run by all the threads, "
+            "sharded: an io_service and an acceptor per thread")
+        ("threads,t", po::value(&threads)->default_value(4),
+            "number of the threads, 0 for the number of cores (sharded only)")
+        ("cert", po::value(&cert)->default_value("../ssl/cert.pem"),
+            "certificate file")
+        ("key", po::value(&key)->default_value("../ssl/key.pem"),
+            "private key file")
+        ("credentials", po::value(&credentials_file),
+            "passwords of the devices, reloaded on SIGHUP. "
+            "all the devices are trusted without it")
+        ("hash-password", po::value<std::string>(),
+            "print the hash of a password for the credentials file")
+        ("tls-session-cache", po::value(&config.tls_session_cache_size)
+            ->default_value(config.tls_session_cache_size),
+            "number of the tls sessions cached for resumption, 0 for none")
+        ("tls-session-timeout", po::value(&config.tls_session_timeout)
+            ->default_value(config.tls_session_timeout),
+            "lifetime of a tls session, in s")
+        ("tls-ticket-key-lifetime", po::value(&config.tls_ticket_key_lifetime)
+            ->default_value(config.tls_ticket_key_lifetime),
+            "the key sealing the tls session tickets is renewed every this s")
+        ("no-tls-tickets", "resume the tls sessions from the cache only")
+        ("tls-resume-unclean", "keep resumable the tls sessions of the "
+            "connections dropped without close_notify")
+        ("trace-sample", po::value(&config.trace_sample_period)
+            ->default_value(config.trace_sample_period),
+            "trace one in this many events of each device, "
+            "from read to write (see the metrics), 0 for none")
+        ("admin-port", po::value(&admin.port)->default_value(0),
+            "port serving the metrics (prometheus text format, "
+            "http://address:port/metrics), 0 for none")
+        ("admin-address", po::value(&admin.address)->default_value("127.0.0.1"),
+            "address the metrics are served on");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch (const po::error &e) {
+        std::cerr << e.what() << "\n" << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    if (vm.count("hash-password")) {
+        std::cout << credential_store::hash_password(
+            vm["hash-password"].as<std::string>()) << std::endl;
+        return 0;
+    }
+    if (mode != "single" && mode != "sharded") {
+        std::cerr << "unknown mode: " << mode << "\n" << desc << std::endl;
+        return 1;
+    }
+    bool sharded = mode == "sharded";
+    config.tls_tickets = !vm.count("no-tls-tickets");
+    config.tls_resume_unclean = vm.count("tls-resume-unclean") != 0;
+
+    std::shared_ptr<credential_store> credentials;
+    io_service signals_service;
+    signal_set hangup(signals_service);
+    /* rearmed by its own handler, must outlive signals_thread */
+    std::function<void()> wait_hangup;
+    std::thread signals_thread;
+    if (!credentials_file.empty()) {
+        credentials = std::make_shared<credential_store>();
+        std::string error;
+        if (!credentials->load(credentials_file, error)) {
+            std::cerr << credentials_file << ": " << error << std::endl;
+            return 1;
+        }
+        /* reloaded aside, the sessions go on with the old entries meanwhile */
+        hangup.add(SIGHUP);
+        wait_hangup = [&] {
+            hangup.async_wait([&](const error_code &ec, int) {
+                if (ec)
+                    return ;
+                std::string error;
+                if (credentials->reload(error))
+                    std::cout << "credentials: " + std::to_string(credentials->size()) + "\n";
+                else
+                    std::cerr << credentials_file + ": " + error + "\n";
+                wait_hangup();
+            });
+        };
+        wait_hangup();
+        signals_thread = std::thread([&signals_service] { signals_service.run(); });
+    }
+
+    config.credentials = credentials;
+
+    std::locale::global(std::locale("en_US.UTF-8"));
+    if (vm.count("plain")) {
+        if (sharded)
+            run_sharded<basic_server>(threads, config, admin, port);
+        else
+            run_single<basic_server>(threads, config, admin, port);
+    }
+    else {
+        ssl::context sslctx(ssl::context::sslv23);
+        sslctx.set_options(
+            ssl::context::default_workarounds |
+            ssl::context::no_sslv2);
+        sslctx.set_password_callback(
+            [](std::size_t max_length, ssl::context::password_purpose purpose)
+            -> std::string
+            { return "qwerty112358"; });
+        sslctx.use_certificate_file(cert, ssl::context::pem);
+        sslctx.use_private_key_file(key, ssl::context::pem);
+        if (sharded)
+            run_sharded<ssl_server_standalone>(threads, config, admin, sslctx, port);
+        else
+            run_single<ssl_server_standalone>(threads, config, admin, sslctx, port);
+    }
+    signals_service.stop();
+    if (signals_thread.joinable())
+        signals_thread.join();
     std::cout << "bye..." << std::endl;
     return 0;
-#endif
 }
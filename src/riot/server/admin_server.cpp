@@ -0,0 +1,123 @@
+#include <memory>
+#include <chrono>
+
+#include <src/riot/server/admin_server.hpp>
+
+using namespace std;
+
+namespace riot { namespace server {
+
+namespace {
+
+const size_t max_request_size = 8192;
+const size_t max_connections = 16;
+const std::chrono::seconds request_timeout(5);    /* to read and to answer */
+
+string response(const char *status, const string &body)
+{
+    return string("HTTP/1.0 ") + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+}
+
+}
+
+/* a request being served, on a strand of its own so that the deadline
+ * doesn't race with the reads and the writes */
+struct admin_server::connection {
+    io_service::strand strand;
+    ip::tcp::socket socket;
+    steady_timer deadline;
+    boost::asio::streambuf request { max_request_size };
+    string reply;
+    shared_ptr<atomic<size_t>> active;
+
+    connection(
+        io_service &io_service,
+        ip::tcp::socket &&s,
+        shared_ptr<atomic<size_t>> a) :
+        strand(io_service),
+        socket(move(s)),
+        deadline(io_service),
+        active(move(a))
+    {
+        active->fetch_add(1);
+    }
+
+    ~connection()
+    {
+        active->fetch_sub(1);
+    }
+};
+
+admin_server::admin_server(
+    io_service &io_service,
+    const string &address,
+    unsigned short port,
+    const metrics_registry &metrics) :
+    io_service_(io_service),
+    acceptor_(io_service, ip::tcp::endpoint(ip::make_address(address), port)),
+    socket_(io_service),
+    metrics_(metrics),
+    active_(make_shared<atomic<size_t>>(0))
+{
+}
+
+void admin_server::start()
+{
+    do_accept();
+}
+
+void admin_server::stop()
+{
+    post(io_service_, [this] { acceptor_.cancel(); });
+}
+
+void admin_server::do_accept()
+{
+    acceptor_.async_accept(socket_, [this](const boost::system::error_code &err) {
+        if (err)
+            return ;
+        /* the accepts are serial, only the releases are concurrent */
+        if (active_->load() < max_connections)
+            serve(move(socket_));
+        socket_ = ip::tcp::socket(io_service_);
+        do_accept();
+    });
+}
+
+void admin_server::serve(ip::tcp::socket socket)
+{
+    auto c = make_shared<connection>(io_service_, move(socket), active_);
+    c->deadline.expires_after(request_timeout);
+    c->deadline.async_wait(c->strand.wrap([c](const boost::system::error_code &ec) {
+        if (ec)
+            return ;    /* cancelled, answered */
+        boost::system::error_code ignored;
+        c->socket.close(ignored);
+    }));
+    async_read_until(c->socket, c->request, "\r\n\r\n", c->strand.wrap(
+        [this, c](const boost::system::error_code &ec, size_t) {
+            if (ec) {
+                c->deadline.cancel();
+                return ;
+            }
+            istream in(&c->request);
+            string method, target;
+            in >> method >> target;
+            c->reply =
+                method != "GET" ? response("405 Method Not Allowed", "") :
+                target == "/metrics" || target == "/" ?
+                    response("200 OK", metrics_.prometheus()) :
+                    response("404 Not Found", "");
+            async_write(c->socket, buffer(c->reply), c->strand.wrap(
+                [c](const boost::system::error_code &, size_t) {
+                    c->deadline.cancel();
+                    boost::system::error_code ignored;
+                    c->socket.shutdown(ip::tcp::socket::shutdown_both, ignored);
+                }));
+        }));
+}
+
+}}
@@ -0,0 +1,58 @@
+#ifndef ADMIN_SERVER_HPP_INCLUDED
+#define ADMIN_SERVER_HPP_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <boost/asio.hpp>
+
+#include <src/riot/server/metrics.hpp>
+
+namespace riot { namespace server {
+
+using namespace boost::asio;
+
+/**
+ * @brief minimal http server exposing the metrics of the servers, in the
+ * prometheus text format at /metrics, for scraping. it's meant to listen on
+ * a local address, apart from the devices.
+ *
+ * a request is answered and the connection closed. the connections not
+ * answered within a few seconds are closed, and only a few of them are
+ * served at once, the others are closed when accepted.
+ */
+class admin_server {
+public:
+    /**
+     * @brief constructor, listens on the given address and port.
+     *
+     * @param metrics metrics served, must outlive the server.
+     */
+    admin_server(
+        io_service &io_service,
+        const std::string &address,
+        unsigned short port,
+        const metrics_registry &metrics);
+
+    void start();
+
+    void stop();
+private:
+    struct connection;
+
+    io_service &io_service_;
+    ip::tcp::acceptor acceptor_;
+    ip::tcp::socket socket_;
+    const metrics_registry &metrics_;
+    /* connections being served, shared with them: they might be released
+     * after the server */
+    std::shared_ptr<std::atomic<std::size_t>> active_;
+
+    void do_accept();
+    void serve(ip::tcp::socket socket);
+};
+
+}}
+
+#endif // ADMIN_SERVER_HPP_INCLUDED
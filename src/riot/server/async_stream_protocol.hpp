@@ -2,37 +2,63 @@
 #define SERVER_PROTOCOL_HPP_INCLUDED
 
 #include <memory>
+#include <memory_resource>
+#include <array>
+#include <cstddef>
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <list>
+#include <deque>
 #include <map>
-#include <regex>
+#include <unordered_map>
+#include <tuple>
 #include <algorithm>
 #include <utility>
+#include <string_view>
 #include <type_traits>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <boost/asio.hpp>
+#include <boost/asio/ssl/stream.hpp>
 
 #include <src/riot/server/header_parser.hpp>
 #include <src/riot/server/command_parser.hpp>
 #include <src/riot/server/xeid_matcher.hpp>
+#include <src/riot/server/line_buffer.hpp>
+#include <src/riot/server/payload.hpp>
+#include <src/riot/server/event_queue.hpp>
+#include <src/riot/server/metrics.hpp>
+#include <src/riot/server/event_trace.hpp>
+#include <src/riot/server/session_registry.hpp>
+#include <src/riot/server/p2p_directory.hpp>
+#include <src/riot/server/cross_shard.hpp>
+#include <src/riot/server/subscription_index.hpp>
+#include <src/riot/server/symbol_table.hpp>
 
 namespace riot { namespace server {
 
 using namespace boost::asio;
 using boost::system::error_code;
 
+template <typename T>
+struct is_ssl_stream : std::false_type {};
+
+template <typename Stream>
+struct is_ssl_stream<ssl::stream<Stream>> : std::true_type {};
+
 
 class async_stream_protocol_base :
     public std::enable_shared_from_this<async_stream_protocol_base>,
-    public strand {
+    public io_service::strand {
 public:
     
     using ptr = std::shared_ptr<async_stream_protocol_base>;
     using wptr = std::weak_ptr<async_stream_protocol_base>;
     using buffer_type = std::vector<char>;
-    using buffer_ptr_type = std::shared_ptr<buffer_type>;
+    using buffer_ptr_type = payload::ptr;
     
     /**
      * @brief constructor.
@@ -40,7 +66,7 @@ public:
      * @param io_service io_service object on which the strand is constructed.
      */
     async_stream_protocol_base(io_service &io_service) :
-        strand(io_service),
+        io_service::strand(io_service),
         io_service_(io_service)
     {}
     
@@ -72,9 +98,9 @@ public:
      */
     template <typename T>
     static buffer_ptr_type to_buffer(T &&t) {
-        auto result = std::make_shared<buffer_type>(t.size());
-        std::copy(t.begin(), t.end(), result->begin());
-        return result;
+        return payload::make(t.size(), [&t](char *out) {
+            std::copy(t.begin(), t.end(), out);
+        });
     }
     
     /**
@@ -91,10 +117,7 @@ public:
      */
     template <typename ...T>
     void async_print(T && ...t) {
-        std::ostringstream oss;
-        using helper_t = int [];
-        (void) helper_t { 0, ( oss << t, 0 ) ... };
-        async_write(to_buffer(oss.str()));
+        async_write(payload::format(t...));
     }
     
     /**
@@ -109,19 +132,117 @@ public:
     /**
      * @brief posts a triggering operation to the device.
      * 
+     * the event is already routed, i.e. this device has a subscription
+     * matching the eid of trigger_xeidm and the name and type of the
+     * trigging_device, and this device fits with the name and type
+     * conditions of trigger_xeidm.
+     * 
      * @param  trigging_device a shared pointer to the device triggering the
-     * event on this device. its name() and type() must match with some of
-     * the subscribed events, along with the eid of the trigger_xeidm.
-     * @param  trigger_xeidm it's used for two purposes. The First purpose is 
-     * that its eid member is checked in subscribed events. The second purpose
-     * is checking if this device fits with the name and type conditions of the 
-     * triggering device.
-     * @param  data it's the triggering data.
+     * event on this device.
+     * @param  trigger_xeidm xeid given to the trig command.
+     * @param  data it's the triggering data, shared by all the recipients.
+     * @param  trace timestamps of the event if it's sampled, or null.
      */
     virtual void async_trigger(
         ptr trigging_device,
-        xeid_matcher trigger_xeidm,
-        buffer_ptr_type data)
+        const xeid_matcher &trigger_xeidm,
+        buffer_ptr_type data,
+        event_trace_ptr trace)
+    {}
+    
+    /**
+     * @brief posts a triggering operation to the device, through a
+     * subscription having a minimum period. the event is delivered if the
+     * period has passed since the last delivery of the subscription,
+     * otherwise it's kept, replacing the previous one kept, and delivered
+     * at the end of the period.
+     * 
+     * @param  subID identifier of the subscription matching the event.
+     */
+    virtual void async_trigger_limited(
+        ptr trigging_device,
+        const xeid_matcher &trigger_xeidm,
+        buffer_ptr_type data,
+        std::uint64_t subID)
+    {}
+    
+    /**
+     * @brief posts a delivery of the events kept by the rate limited
+     * subscriptions whose period has passed. called by the flush timer of
+     * the server.
+     * 
+     */
+    virtual void async_flush()
+    {}
+    
+    /**
+     * @brief posts a piece of a p2p transfer to the device, written right
+     * after its header.
+     * 
+     * @param header P2P line announcing the piece.
+     * @param data bytes of the piece, shared by all the recipients.
+     */
+    virtual void async_p2p(buffer_ptr_type header, buffer_ptr_type data)
+    {}
+    
+    /**
+     * @brief returns true if the device accepts p2p transfers.
+     * 
+     * @return bool
+     */
+    bool accepts_p2p() const
+    { return accepts_p2p_.load(std::memory_order_relaxed); }
+    
+    /**
+     * @brief takes one of the p2p connections the device accepts (p2p-accept
+     * maxconnections=), for a device sending to it. it doesn't lock, any
+     * strand may call it.
+     * 
+     * @return bool false if the device doesn't accept or if all of them are
+     * taken.
+     */
+    bool acquire_p2p_link() {
+        auto n = p2p_inbound_.load(std::memory_order_relaxed);
+        do {
+            if (!accepts_p2p() || n >= p2p_max_inbound_.load(std::memory_order_relaxed))
+                return false;
+        } while (!p2p_inbound_.compare_exchange_weak(n, n + 1, std::memory_order_relaxed));
+        return true;
+    }
+    
+    /**
+     * @brief gives back a connection taken by acquire_p2p_link().
+     * 
+     */
+    void release_p2p_link()
+    { p2p_inbound_.fetch_sub(1, std::memory_order_relaxed); }
+    
+    /**
+     * @brief returns true while the events queued for the device are above
+     * the half of the limits, or the replies and the p2p transfers queued are
+     * above the half of max_queue_bytes, until they go below the quarter.
+     * 
+     * @return bool
+     */
+    bool congested() const
+    { return congested_.load(std::memory_order_relaxed); }
+    
+    /**
+     * @brief posts the registration of a publisher paused because this
+     * device is congested. async_release() is called on the publisher once
+     * the congestion ends, or right away if it has already ended.
+     * 
+     * @param publisher device whose reading is paused.
+     */
+    virtual void async_hold(ptr publisher)
+    {}
+    
+    /**
+     * @brief posts the end of a hold on this device, its reading continues
+     * when all of them are ended.
+     * 
+     */
+    virtual void async_release()
     {}
     
     /**
@@ -130,10 +251,13 @@ public:
      * this function has no thread-safety protections, it must called only
      * after it's added to connection list, i.e. in phase_active.
      * 
-     * @return std::string name of the device.
+     * @return const std::string& name of the device, stored in the symbol
+     * table.
      */
-    virtual std::string name() const
-    {}
+    virtual const std::string &name() const {
+        static const std::string none;
+        return none;
+    }
     
     /**
      * @brief returns a const reference to the request header.
@@ -144,6 +268,24 @@ public:
     virtual const header_parser& header() const
     {}
     
+    /**
+     * @brief called by the idle timer of the server on the deadline of the
+     * session, stops the session if it has been idle since.
+     * 
+     * @param now current tick of the timer.
+     * @return std::uint64_t next deadline, or 0 if stopped.
+     */
+    virtual std::uint64_t check_idle(std::uint64_t now)
+    { return 0; }
+    
+    /**
+     * @brief returns the io_service running the handlers of the session.
+     * 
+     * @return io_service&
+     */
+    io_service &shard() const
+    { return io_service_; }
+    
     /**
      * @brief destructor.
      * 
@@ -152,6 +294,10 @@ public:
     {}
 protected:
     io_service &io_service_;    
+    std::atomic<bool> congested_ { false };
+    std::atomic<bool> accepts_p2p_ { false };
+    std::atomic<std::uint64_t> p2p_inbound_ { 0 };
+    std::atomic<std::uint64_t> p2p_max_inbound_ { 0 };
 };
 
 template <typename AsyncStream, typename Server>
@@ -172,7 +318,19 @@ public:
         async_stream_protocol_base(io_service),
         io_service_(io_service),
         server_(server),
-        s_(std::forward<AsyncStream>(s)) {
+        events_(
+            server.config.max_queue_bytes,
+            server.config.max_queue_messages,
+            server.config.queue_overflow),
+        paused_events_(
+            server.config.max_queue_bytes,
+            server.config.max_paused_events,
+            server.config.paused_latest_per_eid ?
+                overflow_policy::coalesce : overflow_policy::drop_oldest),
+        s_(std::forward<AsyncStream>(s)),
+        read_buffer_(
+            server.config.read_buffer_size,
+            server.config.max_line_length) {
     }
     
     /**
@@ -245,6 +403,7 @@ public:
         // handlers must hold pointers to this shared pointer
         // to ensure it's alive
         post([this, c = this->shared_from_this()] {
+            closed_cleanly_ = !failed_;
             s_.lowest_layer().close();
         });
     }
@@ -256,9 +415,9 @@ public:
      */
     void async_write(buffer_ptr_type buf) override {
         post([this, c = this->shared_from_this(), buf] {
-            write_queue_.push_back(buf);
-            if (write_queue_.size() == 1)   // no on-going write
-                do_write();
+            write_bytes_ += buf->size();
+            write_queue_.push_back(std::move(buf));
+            do_write();     // no-op if there is an on-going write
         });
     }
     
@@ -266,19 +425,90 @@ public:
      * @brief posts a triggering operation to the device.
      * 
      * @param  trigging_device a shared pointer to the device triggering the
-     * event on this device. its name() and type() must match with some of
-     * the subscribed events, along with the eid of the trigger_xeidm.
-     * @param  trigger_xeidm it's used for two purposes. The First purpose is 
-     * that its eid member is checked in subscribed events. The second purpose
-     * is checking if this device fits with the name and type conditions of the 
-     * triggering device.
-     * @param  data it's the triggering data.
+     * event on this device.
+     * @param  trigger_xeidm xeid given to the trig command.
+     * @param  data it's the triggering data, shared by all the recipients.
+     * @param  trace timestamps of the event if it's sampled, or null.
      */
     void async_trigger(
         ptr trigging_device,
-        xeid_matcher trigger_xeidm,
-        buffer_ptr_type data) override {
-        // TODO a lot of code to come
+        const xeid_matcher &trigger_xeidm,
+        buffer_ptr_type data,
+        event_trace_ptr trace) override {
+        auto key = event_key(*trigging_device, trigger_xeidm);
+        post([this, c = this->shared_from_this(), data, key, trace]() mutable {
+            if (trace)
+                start_trace(data, *trace);
+            enqueue_event(std::move(data), key);
+            do_write();
+        });
+    }
+    
+    void async_trigger_limited(
+        ptr trigging_device,
+        const xeid_matcher &trigger_xeidm,
+        buffer_ptr_type data,
+        std::uint64_t subID) override {
+        auto key = event_key(*trigging_device, trigger_xeidm);
+        post([this, c = this->shared_from_this(), data, key, subID]() mutable {
+            auto it = rate_limits_.find(subID);
+            if (it == rate_limits_.end())
+                return ;    /* unsubscribed meanwhile */
+            auto &limit = it->second;
+            auto now = clock_type::now();
+            if (!limit.pending && now - limit.last_delivery >= limit.minperiod) {
+                limit.last_delivery = now;
+                enqueue_event(std::move(data), key);
+                do_write();
+                return ;
+            }
+            limit.pending = std::move(data);    /* coalesced to the latest */
+            limit.pending_key = key;
+            schedule_flush(limit.last_delivery + limit.minperiod);
+        });
+    }
+    
+    void async_flush() override {
+        post([this, c = this->shared_from_this()] {
+            do_flush();
+        });
+    }
+    
+    void async_p2p(buffer_ptr_type header, buffer_ptr_type data) override {
+        post([this, c = this->shared_from_this(), header, data] {
+            write_bytes_ += header->size() + data->size();
+            write_queue_.push_back(std::move(header));
+            write_queue_.push_back(std::move(data));
+            update_congestion();
+            do_write();
+        });
+    }
+    
+    void async_hold(ptr publisher) override {
+        post([this, c = this->shared_from_this(), publisher] {
+            if (congested())
+                holding_.push_back(publisher);
+            else
+                publisher->async_release();
+        });
+    }
+    
+    void async_release() override {
+        post([this, c = this->shared_from_this()] {
+            if (holds_ == 0 || --holds_ > 0 || !held_)
+                return ;
+            held_ = false;
+            async_println("CONTINUE");
+            do_async_read();    /* or the p2p transfer */
+        });
+    }
+    
+    std::uint64_t check_idle(std::uint64_t now) override {
+        auto deadline = last_activity_.load(std::memory_order_relaxed) + idle_ticks_;
+        if (deadline > now)
+            return deadline;
+        async_stop();
+        return 0;
     }
     
     /**
@@ -287,10 +517,12 @@ public:
      * this function has no thread-safety protections, it must called only
      * after it's added to connection list, i.e. in phase_active.
      * 
-     * @return std::string name of the device.
+     * @return const std::string& name of the device, stored in the symbol
+     * table.
      */
-    std::string name() const override {
-        return name_;
+    const std::string &name() const override {
+        return name_ == no_symbol ?
+            async_stream_protocol_base::name() : symbols().str(name_);
     }
     
     /**
@@ -303,22 +535,108 @@ public:
         return header_;
     }
     
+    /**
+     * @brief logs in a batch of sessions, on a worker of the authenticator
+     * of the server. the sessions wait in phase_intermediate meanwhile, with
+     * no reading pending. the normal names are registered at once, and the
+     * sessions are resumed with a handler per io_service.
+     * 
+     * @param batch sessions whose header is received.
+     * @param worker io_service of the workers.
+     */
+    static void login_batch(
+        std::vector<std::shared_ptr<async_stream_protocol>> &batch,
+        io_service &worker) {
+        static const char *err_multi_login      = "multiple login not allowed";
+        std::vector<typename registry_type::insert_request> inserts;
+        for (auto &session: batch) {
+            if (session->authenticate())
+                inserts.push_back({
+                    session->name_,
+                    session->type_,
+                    session->header_.name_policy == header_parser::weak,
+                    session });
+        }
+        if (!inserts.empty())
+            batch.front()->server_.registry.insert_batch(inserts);
+        for (auto &r: inserts) {
+            if (r.result == registry_type::taken) {
+                auto session = static_cast<async_stream_protocol *>(r.session.get());
+                session->login_error_ = err_multi_login;
+                session->login_error_ += ", not requested";
+            }
+            if (r.displaced)
+                r.displaced->async_stop(); // stop the connection
+        }
+        post_by_shard(worker, batch,
+            [](const std::shared_ptr<async_stream_protocol> &session) {
+                session->dispatch([session] { session->finish_login(); });
+            });
+    }
+    
     /**
      * @brief destructor.
      * 
      */
     
     virtual ~async_stream_protocol() {
+        release_holding();
+        disconnect_p2p_all();
+        server_.subscriptions.unsubscribe_all(this);
+        server_.subscriptions.unnegsubscribe_all(this);
+        if (device_id_ != index_type::no_device)
+            server_.subscriptions.unregister_device(device_id_);
+        if (name_ != no_symbol)
+            server_.registry.erase(name_, this);
+        if (p2p_id_ != p2p_directory_type::no_id)
+            server_.p2p.erase(p2p_id_);
+        if (name_index_)
+            server_.registry.release(base_, name_index_);
+        auto &table = symbols();
+        if (name_ != base_)
+            table.release(name_);   /* enumerated */
+        table.release(base_);
+        table.release(type_);
+    }
+    
+protected:
+    /**
+     * @brief returns true if the connection ended in an orderly way: the
+     * peer ended the stream (with close_notify on tls), or async_stop()
+     * closed it, and no error occurred before. it's only meaningful once
+     * the connection is closed, e.g. in the destructors.
+     * 
+     * @return bool
+     */
+    bool closed_cleanly() const {
+        return closed_cleanly_;
     }
     
 private:
     
+    using registry_type = session_registry<async_stream_protocol_base>;
+    using p2p_directory_type = p2p_directory<async_stream_protocol_base>;
+    using index_type = subscription_index<async_stream_protocol *>;
+    
     io_service &io_service_;
     Server &server_;
-    std::list<buffer_ptr_type> write_queue_;
+    std::deque<buffer_ptr_type> write_queue_;   /* replies and p2p, never dropped */
+    std::size_t write_bytes_ { 0 };             /* in write_queue_ */
+    event_queue events_;            /* triggered, bounded */
+    bool overflowed_ { false };
+    event_queue paused_events_;     /* kept from pause to continue */
+    bool paused_ { false };
+    bool writing_ { false };
+    std::vector<buffer_ptr_type> write_batch_;  /* being written */
+    std::vector<const_buffer> write_gather_;
+    buffer_type write_linear_;
     
     AsyncStream s_;
-    streambuf streambuf_;
+    line_buffer read_buffer_;
+    
+    /* see closed_cleanly(), failed_ is set by the errors of the stream */
+    bool closed_cleanly_ { false };
+    bool failed_ { false };
     
     enum phase_t : int {
         phase_newborn = 0,
@@ -327,226 +645,1011 @@ private:
     };
     phase_t phase_ { phase_newborn };
     
-    header_parser header_;
+    /* the strings of the header are allocated in an arena of the session,
+     * freed with it. the commands are parsed in another, reset for each
+     * line; the strings of their xeids stay on the heap, the subscriptions
+     * take them */
+    std::array<std::byte, 256> header_storage_;
+    std::pmr::monotonic_buffer_resource header_arena_ {
+        header_storage_.data(), header_storage_.size() };
+    header_parser header_ { &header_arena_ };
+    std::array<std::byte, 256> command_storage_;
+    std::pmr::monotonic_buffer_resource command_arena_ {
+        command_storage_.data(), command_storage_.size() };
     
-    std::string name_;
+    /* interned name and type of the device, and the name given in the
+     * header, of which name_ is an enumeration. their references are
+     * released by the destructor */
+    symbol name_ { no_symbol };
+    symbol type_ { no_symbol };
+    symbol base_ { no_symbol };
+    
+    std::uint64_t name_index_ { 0 };   /* of the enumerated names, or 0 */
+    std::string login_error_;           /* set by the authenticator */
+    std::chrono::steady_clock::time_point login_started_;
+    
+    /* in the ticks of server_.idle_timers, last_activity_ is updated by
+     * every read and checked by the timer */
+    std::atomic<std::uint64_t> last_activity_ { 0 };
+    std::uint64_t idle_ticks_ { 0 };
+    
+    std::uint64_t next_sub_id_ { 1 };
+    std::uint64_t next_negsub_id_ { 1 };
+    
+    /* id of this device in the subscription index, for the negsubs */
+    typename index_type::device_id device_id_ { index_type::no_device };
+    
+    using clock_type = std::chrono::steady_clock;
+    
+    /* state of a subscription having a minperiod */
+    struct rate_limit {
+        clock_type::duration minperiod;
+        clock_type::time_point last_delivery {};
+        buffer_ptr_type pending;    /* latest event not delivered yet */
+        std::uint64_t pending_key { 0 };
+    };
+    std::unordered_map<std::uint64_t, rate_limit> rate_limits_;
+    bool flush_scheduled_ { false };
+    clock_type::time_point flush_deadline_;
+    
+    /* backpressure: the publishers paused while this device is congested,
+     * and the congested recipients on which this device is paused. a
+     * paused publisher has no read pending, it's kept alive here */
+    std::vector<ptr> holding_;
+    std::size_t holds_ { 0 };
+    bool held_ { false };
+    
+    /* p2p transfer being received from this device, either the bytes
+     * remaining or the next line */
+    std::vector<ptr> p2p_recipients_;
+    std::uint64_t p2p_remaining_ { 0 };
+    bool p2p_line_ { false };
+    
+    /* the devices this device sends to by p2pID, each holding one of the
+     * connections of the peer. only this strand touches it, the peers are
+     * shared through their atomic counters */
+    std::unordered_map<std::uint64_t, wptr> p2p_links_;
+    
+    /* p2pID of this device, given on its first p2p-accept and never reused */
+    std::uint64_t p2p_id_ { p2p_directory_type::no_id };
+    
+    /* tracing, see server_configuration::trace_sample_period: when the
+     * last read completed and the trigs until the next sampled one, then
+     * the sampled events received, queued and being written */
+    clock_type::time_point read_time_;
+    std::uint64_t trace_countdown_ { 0 };
+    struct pending_trace {
+        buffer_ptr_type data;
+        clock_type::time_point read;
+        clock_type::time_point enqueued;
+    };
+    static constexpr std::size_t max_pending_traces = 16;
+    std::vector<pending_trace> traces_;
+    std::vector<pending_trace> traces_writing_;
+    
+    /**
+     * @brief records the error ending an operation on the stream: the end
+     * of the stream is an orderly close, the aborts follow async_stop(),
+     * the others (resets, truncations, alerts) are failures.
+     * 
+     * @param ec error of the operation.
+     */
+    void stream_error(const error_code &ec) {
+        if (ec == boost::asio::error::eof)
+            closed_cleanly_ = !failed_;
+        else if (ec != boost::asio::error::operation_aborted) {
+            failed_ = true;
+            closed_cleanly_ = false;
+        }
+    }
     
+    /**
+     * @brief serves the complete lines already received, then reads more.
+     * 
+     */
     void do_async_read() {
-        using namespace std::string_literals;
-        async_read_until(s_, streambuf_, '\n', wrap(
+        static const char *err_line_too_long    = "line too long";
+        if (p2p_remaining_) {
+            do_p2p_read();  /* resumed in the middle of a transfer */
+            return ;
+        }
+        std::string_view line;
+        while (read_buffer_.next_line(line)) {
+            if (!handle_line(line))
+                return ; /* suspended, handle_line() takes care of resuming */
+        }
+        auto buf = read_buffer_.prepare();
+        if (buffer_size(buf) == 0) {
+            /* the line is skipped, the following ones are still served */
+            async_println("ERROR ", err_line_too_long);
+            read_buffer_.discard_line();
+            buf = read_buffer_.prepare();
+        }
+        s_.async_read_some(buf, wrap(
             [this, c = this->shared_from_this()]
-            (const error_code &ec, std::size_t /* bytes_transferred */) {
-                // BEGIN error messages
-                static const char *err_auth             = "authentication failed";
-                // static const char *err_assign_name      = "cannot assing the name";
-                static const char *err_multi_login      = "multiple login not allowed";
-                static const char *err_not_init         = "argument not initialized";
-                // END
-                if (ec)
-                    // most probably boost::asio::error::operation_aborted
+            (const error_code &ec, std::size_t bytes_transferred) {
+                if (ec) {
+                    stream_error(ec);
                     return ;
-                
-                std::istream is(&streambuf_);
-                std::string line;
-                std::getline(is, line);
-                
-                switch (phase_)
-                {
-                case phase_newborn:
-                {
-                    if (!header_.feed_line(line))
-                    {
-                        /* we received an end message */
-                        ((int&) phase_)++;  /* get into next phase */
-                        if (!header_.is_fine()) {
-                            async_println("ERROR ", header_.error_msg());
-                            return ;
-                        }
-                        else {
-                            /* no syntax error, check required args */
-                            if (header_.name.empty()) {
-                                async_println("ERROR ", err_not_init, " : name"s);
-                                return ;
-                            }
-                            if (header_.type.empty()) {
-                                async_println("ERROR ", err_not_init, " : type"s);
-                                return ;
-                            }
-                            if (header_.version.empty()) {
-                                async_println("ERROR ", err_not_init, " : RIOTp"s);
-                                return ;
-                            }
-                            
-                            server_.post([this, c /* keep ref */] {
-                                /* check credentials */
-                                bool multiple_login = false;
-                                bool trusted = server_.config.check_credentials(
-                                    header_.name,
-                                    header_.password,
-                                    multiple_login);
-                                
-                                if (!trusted) {
-                                    async_println("ERROR ", err_auth);
-                                    return ;
-                                }
-                                
-                                /* search in valid names in server */
-                                switch (header_.name_flag) {
-                                case header_parser::normal: {
-                                    bool name_free = true;
-                                    server_.for_each_session([&](auto conn, bool &remove) -> bool {
-                                        if (conn->name() == header_.name) {
-                                            if (conn->header().name_policy == header_parser::weak) {
-                                                conn->async_stop(); // stop the connection
-                                                remove = true;
-                                                // there cannot be other devices having this ID
-                                                // so stop the loop
-                                            }
-                                            else {
-                                                name_free = false;
-                                            }
-                                            return false;
-                                        }
-                                        return true;
-                                    }) /* blocking, no need to keep ref */;
-                                    if (name_free) {
-                                        server_.sessions.push_back(c);
-                                        ((int&) phase_)++;
-                                        name_ = header_.name;
-                                        async_println("OK ", name_);
-                                        do_async_read();    // continue
-                                        return ;
-                                    }
-                                    else {
-                                        
-                                        async_println("ERROR ", err_multi_login, ", not requested");
-                                        return ;
-                                    }
-                                    break;
-                                }
-                                case header_parser::uniquify:   /* yes, they are the same thing, for now */
-                                case header_parser::enumerated: {
-                                    std::regex rgx {header_.name + "_(\\d+)"};
-                                    std::list<uint64_t> occupied_numbers;
-                                    server_.for_each_session([&](auto conn, bool &) -> bool {
-                                        std::smatch m;
-                                        auto name = conn->name();   // use of deleted function error?
-                                        if (std::regex_match(name, m, rgx)) {
-                                            occupied_numbers.push_back(std::stoul(m[1]));
-                                        }
-                                        return true;
-                                    });
-                                    if (occupied_numbers.empty()) {
-                                        server_.sessions.push_back(c);
-                                        ((int&) phase_)++;
-                                        name_ = header_.name + "_1";
-                                        async_println("OK ", name_);
-                                        do_async_read();    // continue
-                                        return ;
-                                    }
-                                    else {
-                                        if (multiple_login) {
-                                            int index = 1;
-                                            while (std::find(occupied_numbers.begin(),
-                                                            occupied_numbers.end(),
-                                                            index) != occupied_numbers.end() /* it exists */)
-                                                index++;
-                                            /* now index is unique */
-                                            server_.sessions.push_back(c);
-                                            ((int&) phase_)++;
-                                            name_ = header_.name + "_" + std::to_string(index);
-                                            async_println("OK ", name_);
-                                            do_async_read();    // continue
-                                        }
-                                        else {
-                                            async_println("ERROR ", err_multi_login, ", administrator doesn't permit");
-                                            return ;
-                                        }
-                                    }
-                                    break;
-                                }
-                                }
-                            });
+                }
+                last_activity_.store(
+                    server_.idle_timers.now(), std::memory_order_relaxed);
+                server_.metrics.add(metrics_registry::bytes_in, bytes_transferred);
+                if (server_.config.trace_sample_period)
+                    read_time_ = clock_type::now();
+                read_buffer_.commit(bytes_transferred);
+                do_async_read();
+        }));
+    }
+    
+    /**
+     * @brief handles a single line.
+     * 
+     * @param line line without the trailing new line, valid only during the
+     * call.
+     * @return bool true to continue with the next line, false if reading is
+     * suspended.
+     */
+    bool handle_line(std::string_view line) {
+        switch (phase_)
+        {
+        case phase_newborn:
+        {
+            if (header_.feed_line(line))
+                return true;    /* continue */
+            /* we received an end message */
+            ((int&) phase_)++;  /* get into next phase */
+            do_login();
+            return false;
+        }
+        case phase_intermediate:
+        {
+            // not possible
+            return true;
+        }
+        case phase_active:
+        {
+            if (p2p_line_)
+                forward_p2p_line(line);
+            else
+                handle_command(line);
+            if (p2p_remaining_)
+                forward_buffered_p2p();
+            if (hold())
+                return false;
+            if (p2p_remaining_ == 0)
+                return true;
+            do_p2p_read();  /* the rest of the transfer isn't received yet */
+            return false;
+        }
+        }
+        return true;
+    }
+    
+    /**
+     * @brief validates the received header and hands the login to the
+     * authenticator of the server. reading is resumed by finish_login() if
+     * the login succeeds.
+     * 
+     */
+    void do_login() {
+        using namespace std::string_literals;
+        // BEGIN error messages
+        static const char *err_not_init         = "argument not initialized";
+        // END
+        if (!header_.is_fine()) {
+            server_.metrics.add(metrics_registry::login_failures);
+            async_println("ERROR ", header_.error_msg());
+            return ;
+        }
+        /* no syntax error, check required args */
+        if (header_.name.empty()) {
+            server_.metrics.add(metrics_registry::login_failures);
+            async_println("ERROR ", err_not_init, " : name"s);
+            return ;
+        }
+        if (header_.type.empty()) {
+            server_.metrics.add(metrics_registry::login_failures);
+            async_println("ERROR ", err_not_init, " : type"s);
+            return ;
+        }
+        if (header_.version.empty()) {
+            server_.metrics.add(metrics_registry::login_failures);
+            async_println("ERROR ", err_not_init, " : RIOTp"s);
+            return ;
+        }
+        login_started_ = std::chrono::steady_clock::now();
+        server_.authenticator.submit(
+            std::static_pointer_cast<async_stream_protocol>(this->shared_from_this()));
+    }
+    
+    /**
+     * @brief checks the credentials and registers the device, on a worker of
+     * the authenticator. a normal name is left to the caller, to be
+     * registered together with the others of the batch.
+     * 
+     * @return bool true if the name is to be registered by the caller.
+     */
+    bool authenticate() {
+        // BEGIN error messages
+        static const char *err_auth             = "authentication failed";
+        // static const char *err_assign_name      = "cannot assing the name";
+        static const char *err_multi_login      = "multiple login not allowed";
+        // END
+        bool multiple_login = false;
+        bool trusted = server_.config.check_credentials(
+            header_.name,
+            header_.type,
+            header_.password,
+            multiple_login);
+        
+        if (!trusted) {
+            login_error_ = err_auth;
+            return false;
+        }
+        
+        base_ = symbols().intern(header_.name);
+        type_ = symbols().intern(header_.type);
+        
+        /* search in valid names in server */
+        switch (header_.name_flag) {
+        case header_parser::normal: {
+            name_ = base_;  /* set before it's visible to others */
+            return true;
+        }
+        case header_parser::uniquify:   /* yes, they are the same thing, for now */
+        case header_parser::enumerated: {
+            ptr displaced;
+            auto result = server_.registry.insert_enumerated(
+                base_, type_, header_.name_policy == header_parser::weak,
+                multiple_login, this->shared_from_this(),
+                name_, name_index_, displaced);
+            if (result == registry_type::taken) {
+                login_error_ = err_multi_login;
+                login_error_ += ", administrator doesn't permit";
+            }
+            if (displaced)
+                displaced->async_stop();
+            break;
+        }
+        }
+        return false;
+    }
+    
+    /**
+     * @brief completes the login on the strand, once authenticated: replies
+     * and resumes reading, or reports the failure.
+     * 
+     */
+    void finish_login() {
+        auto &metrics = server_.metrics;
+        if (!login_error_.empty()) {
+            metrics.add(metrics_registry::login_failures);
+            async_println("ERROR ", login_error_);
+            return ;
+        }
+        metrics.add(metrics_registry::logins);
+        metrics.record(metrics_registry::login_ns,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - login_started_).count());
+        ((int&) phase_)++;
+        device_id_ = server_.subscriptions.register_device(name_, type_);
+        if (header_.has_timeout) {
+            auto &timers = server_.idle_timers;
+            idle_ticks_ = std::max<std::uint64_t>(
+                1, timers.ticks(std::chrono::milliseconds(header_.timeout)));
+            last_activity_.store(timers.now(), std::memory_order_relaxed);
+            timers.schedule(this->shared_from_this(), timers.now() + idle_ticks_);
+        }
+        async_println("OK ", name());
+        do_async_read();    // continue, we are already in the strand
+    }
+    
+    /**
+     * @brief parses and executes a command of an active session.
+     * 
+     * @param line line received.
+     */
+    void handle_command(std::string_view line) {
+        static const char *err_invalid_id       = "invalid identifier";
+        command_arena_.release();   /* of the previous line */
+        command_parser command(&command_arena_);
+        bool parsed = command.parse(line);
+        server_.metrics.add_command(command.type());
+        if (parsed) {
+            switch (command.type()) {
+                case command_parser::trig: {
+                    auto c = this->shared_from_this();
+                    for (const auto &xeidm: command.s.trig.xeids)
+                        do_trigger(c, xeidm);
+                    break;
+                }
+                case command_parser::sub: {
+                    std::string ids;
+                    std::uint64_t minperiod = command.s.sub.minperiod_exists ?
+                        command.s.sub.minperiod : 0;
+                    for (auto &xeidm: command.s.sub.xeids) {
+                        auto id = next_sub_id_++;
+                        if (minperiod)
+                            rate_limits_[id].minperiod =
+                                std::chrono::milliseconds(minperiod);
+                        server_.subscriptions.subscribe(
+                            this, id, std::move(xeidm), minperiod);
+                        ids += " " + std::to_string(id);
+                    }
+                    async_println("OK", ids);
+                    break;
+                }
+                case command_parser::unsub: {
+                    bool fine = true;
+                    for (auto id: command.s.unsub.subIDs) {
+                        if (!server_.subscriptions.unsubscribe(this, id)) {
+                            async_println("ERROR ", err_invalid_id, " : ", id);
+                            fine = false;
+                            break;
                         }
+                        rate_limits_.erase(id);
                     }
-                    else {
-                        /* continue */
-                        do_async_read();
+                    if (fine && command.s.unsub.all) {
+                        server_.subscriptions.unsubscribe_all(this);
+                        rate_limits_.clear();
                     }
+                    if (fine)
+                        async_println("OK");
                     break;
                 }
-                case phase_intermediate:
-                {
-                    // not possible
-                    do_async_read();
+                case command_parser::negsub: {
+                    std::string ids;
+                    for (auto &xeidm: command.s.negsub.xeids) {
+                        auto id = next_negsub_id_++;
+                        server_.subscriptions.negsubscribe(
+                            this, id, std::move(xeidm));
+                        ids += " " + std::to_string(id);
+                    }
+                    async_println("OK", ids);
                     break;
                 }
-                case phase_active:
-                {
-                    command_parser command;
-                    if (command.parse(line)) {
-                        switch (command.type()) {
-                            case command_parser::trig: {
-                                break;
-                            }
-                            case command_parser::sub: {
-                                break;
-                            }
-                            case command_parser::negsub: {
-                                break;
-                            }
-                            case command_parser::unnegsub: {
-                                break;
-                            }
-                            case command_parser::pause: {
-                                break;
-                            }
-                            case command_parser::cont: {
-                                break;
-                            }
-                            case command_parser::p2p_accept: {
-                                break;
-                            }
-                            case command_parser::p2p_stop_accept: {
-                                break;
-                            }
-                            case command_parser::p2p_disconnect: {
-                                break;
-                            }
-                            case command_parser::p2p_send: {
-                                break;
-                            }
+                case command_parser::unnegsub: {
+                    bool fine = true;
+                    for (auto id: command.s.unnegsub.negsubIDs) {
+                        if (!server_.subscriptions.unnegsubscribe(this, id)) {
+                            async_println("ERROR ", err_invalid_id, " : ", id);
+                            fine = false;
+                            break;
                         }
                     }
-                    else {
-                        if (command.type() == command_parser::empty) {
-                            /* empty line not an error */
-                        }
-                        else {
-                            async_println("ERROR ", command.error_msg());
+                    if (fine && command.s.unnegsub.all)
+                        server_.subscriptions.unnegsubscribe_all(this);
+                    if (fine)
+                        async_println("OK");
+                    break;
+                }
+                case command_parser::pause: {
+                    /* the subscriptions stay, the events are kept */
+                    paused_ = true;
+                    async_println("OK");
+                    break;
+                }
+                case command_parser::cont: {
+                    /* the reply and the kept events go in the same write */
+                    paused_ = false;
+                    async_println("OK");
+                    break;
+                }
+                case command_parser::p2p_accept: {
+                    if (p2p_id_ == p2p_directory_type::no_id)
+                        p2p_id_ = server_.p2p.insert(this->shared_from_this());
+                    p2p_max_inbound_.store(
+                        command.s.p2p.accept.maxconnections, std::memory_order_relaxed);
+                    accepts_p2p_.store(true, std::memory_order_relaxed);
+                    async_println("OK ", p2p_id_);
+                    break;
+                }
+                case command_parser::p2p_stop_accept: {
+                    accepts_p2p_.store(false, std::memory_order_relaxed);
+                    async_println("OK");
+                    break;
+                }
+                case command_parser::p2p_disconnect: {
+                    bool fine = true;
+                    for (auto id: command.s.p2p.disconnect.p2pIDs) {
+                        auto it = p2p_links_.find(id);
+                        if (it == p2p_links_.end()) {
+                            async_println("ERROR ", err_invalid_id, " : ", id);
+                            fine = false;
+                            break;
                         }
+                        if (auto peer = it->second.lock())
+                            peer->release_p2p_link();
+                        p2p_links_.erase(it);
                     }
-                    do_async_read();
+                    if (fine && command.s.p2p.disconnect.all)
+                        disconnect_p2p_all();
+                    if (fine)
+                        async_println("OK");
                     break;
                 }
+                case command_parser::p2p_send: {
+                    start_p2p(command);
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+        }
+        else {
+            if (command.type() == command_parser::empty) {
+                /* empty line not an error */
+            }
+            else {
+                async_println("ERROR ", command.error_msg());
+            }
+        }
+    }
+    
+    /**
+     * @brief starts receiving a p2p transfer, given by "p2pIDs>size" or
+     * "p2pIDs>n", after which the bytes or the line follow. the first
+     * p2pID which can't be sent to is reported, the transfer is consumed
+     * anyway.
+     * 
+     */
+    void start_p2p(const command_parser &command) {
+        const auto &send = command.s.p2p.send;
+        p2p_recipients_.clear();
+        std::vector<std::uint64_t> ids(send.p2pIDs.begin(), send.p2pIDs.end());
+        if (send.all) {
+            ids.clear();
+            for (const auto &link: p2p_links_)
+                ids.push_back(link.first);
+        }
+        const char *error = nullptr;
+        std::uint64_t error_id = 0;
+        for (auto id: ids) {
+            const char *e = nullptr;
+            auto recipient = p2p_link(id, e);
+            if (recipient)
+                p2p_recipients_.push_back(std::move(recipient));
+            else if (!error) {
+                error = e;
+                error_id = id;
+            }
+        }
+        if (error)
+            async_println("ERROR ", error, " : ", error_id);
+        else
+            async_println("OK");
+        p2p_line_ = send.until_newline;
+        p2p_remaining_ = send.until_newline ? 0 : send.size;
+    }
+    
+    /**
+     * @brief returns the device linked by the given p2pID, linking it if
+     * it's not yet. a link whose device is gone or doesn't accept anymore
+     * is dropped.
+     * 
+     * @param error set to the reason if null is returned.
+     * @return ptr
+     */
+    ptr p2p_link(std::uint64_t id, const char *&error) {
+        static const char *err_invalid_id       = "invalid identifier";
+        static const char *err_p2p_full         = "too many p2p connections";
+        auto it = p2p_links_.find(id);
+        if (it != p2p_links_.end()) {
+            auto peer = it->second.lock();
+            if (peer && peer->accepts_p2p())
+                return peer;
+            if (peer)
+                peer->release_p2p_link();
+            p2p_links_.erase(it);
+        }
+        auto peer = server_.p2p.find(id);
+        if (!peer || !peer->accepts_p2p()) {
+            error = err_invalid_id;
+            return nullptr;
+        }
+        if (!peer->acquire_p2p_link()) {
+            error = err_p2p_full;
+            return nullptr;
+        }
+        p2p_links_.emplace(id, peer);
+        return peer;
+    }
+    
+    /**
+     * @brief drops all the p2p links of this device.
+     * 
+     */
+    void disconnect_p2p_all() {
+        for (auto &link: p2p_links_)
+            if (auto peer = link.second.lock())
+                peer->release_p2p_link();
+        p2p_links_.clear();
+    }
+    
+    /**
+     * @brief forwards a piece of the p2p transfer to the recipients.
+     * 
+     */
+    void forward_p2p(buffer_ptr_type data) {
+        auto self = this->shared_from_this();
+        auto header = payload::format("P2P ", name(), ' ', data->size(), '\n');
+        for (auto &recipient: p2p_recipients_) {
+            recipient->async_p2p(header, data);
+            hold_on(self, recipient);
+        }
+    }
+    
+    /**
+     * @brief forwards the line of a "p2pIDs>n" transfer.
+     * 
+     */
+    void forward_p2p_line(std::string_view line) {
+        p2p_line_ = false;
+        if (!p2p_recipients_.empty())
+            forward_p2p(payload::format(line, '\n'));
+        p2p_recipients_.clear();
+    }
+    
+    /**
+     * @brief forwards the bytes of the p2p transfer already received with
+     * the preceding lines.
+     * 
+     */
+    void forward_buffered_p2p() {
+        auto buffered = read_buffer_.data();
+        auto n = std::min<std::uint64_t>(p2p_remaining_, buffered.size());
+        if (n == 0)
+            return ;
+        if (!p2p_recipients_.empty())
+            forward_p2p(payload::copy(buffered.data(), n));
+        read_buffer_.consume(n);
+        p2p_remaining_ -= n;
+        if (p2p_remaining_ == 0)
+            p2p_recipients_.clear();
+    }
+    
+    /**
+     * @brief reads the rest of the p2p transfer piece by piece, each piece
+     * directly into the payload forwarded, then continues with the lines.
+     * 
+     */
+    void do_p2p_read() {
+        forward_buffered_p2p();
+        if (p2p_remaining_ == 0) {
+            do_async_read();
+            return ;
+        }
+        char *bytes;
+        auto n = std::min<std::uint64_t>(p2p_remaining_, server_.config.p2p_chunk_size);
+        auto data = payload::allocate(n, bytes);
+        boost::asio::async_read(s_, buffer(bytes, n), wrap(
+            [this, c = this->shared_from_this(), data]
+            (const error_code &ec, std::size_t bytes_transferred) mutable {
+                if (ec) {
+                    stream_error(ec);
+                    return ;
                 }
+                last_activity_.store(
+                    server_.idle_timers.now(), std::memory_order_relaxed);
+                server_.metrics.add(metrics_registry::bytes_in, bytes_transferred);
+                p2p_remaining_ -= data->size();
+                if (!p2p_recipients_.empty())
+                    forward_p2p(std::move(data));
+                if (p2p_remaining_ == 0)
+                    p2p_recipients_.clear();
+                if (!hold())
+                    do_async_read();
         }));
     }
     
+    /**
+     * @brief matches the device part of an xeid against interned names and
+     * types, comparing the symbols of the literal components. it holds a
+     * reference to them, so that they aren't freed and given to other
+     * strings while it's matching.
+     * 
+     */
+    class interned_device_matcher {
+    public:
+        explicit interned_device_matcher(const xeid_matcher &xeidm) :
+            xeidm_(xeidm),
+            dname_(literal_of(xeidm.dname_pattern())),
+            dtype_(literal_of(xeidm.dtype_pattern()))
+        {}
+        
+        interned_device_matcher(const interned_device_matcher &) = delete;
+        interned_device_matcher &operator=(const interned_device_matcher &) = delete;
+        
+        ~interned_device_matcher() {
+            symbols().release(dname_.sym);
+            symbols().release(dtype_.sym);
+        }
+        
+        bool matches(symbol dname, symbol dtype) const {
+            return dname_.matches(xeidm_.dname_pattern(), dname) &&
+                dtype_.matches(xeidm_.dtype_pattern(), dtype);
+        }
+    private:
+        struct component {
+            bool literal;
+            symbol sym;     /* no_symbol if never interned, matches nothing */
+            
+            bool matches(const xeid_pattern &p, symbol s) const
+            { return literal ? sym == s : p.matches(symbols().str(s)); }
+        };
+        
+        const xeid_matcher &xeidm_;
+        component dname_, dtype_;
+        
+        static component literal_of(const xeid_pattern &p) {
+            if (p.kind() != xeid_pattern::literal)
+                return component { false, no_symbol };
+            return component { true, symbols().acquire(p.key()) };
+        }
+    };
+    
+    /**
+     * @brief routes an event triggered by this device to the subscribed
+     * devices. the event line is serialized once and shared by all the
+     * recipients, a recipient having several matching subscriptions receives
+     * it only once.
+     * 
+     * @param self shared pointer to this object.
+     * @param trigger_xeidm xeid given to the trig command.
+     */
+    void do_trigger(const ptr &self, const xeid_matcher &trigger_xeidm) {
+        struct limited_delivery {
+            ptr recipient;
+            std::uint64_t minperiod;
+            std::uint64_t subID;
+            
+            bool operator<(const limited_delivery &other) const {
+                return std::tie(recipient, minperiod, subID) <
+                    std::tie(other.recipient, other.minperiod, other.subID);
+            }
+        };
+        std::vector<ptr> recipients;
+        std::vector<limited_delivery> limited;
+        interned_device_matcher device_filter(trigger_xeidm);
+        server_.subscriptions.route(
+            trigger_xeidm.eid, name_, type_, device_id_,
+            [&](async_stream_protocol *session,
+                std::uint64_t subID,
+                std::uint64_t minperiod) {
+                /* name_ and type_ are immutable once subscribed */
+                if (!device_filter.matches(session->name_, session->type_))
+                    return ;
+                auto recipient = session->weak_from_this().lock();
+                if (!recipient)
+                    return ;
+                if (minperiod)
+                    limited.push_back({ std::move(recipient), minperiod, subID });
+                else
+                    recipients.push_back(std::move(recipient));
+            });
+        server_.metrics.add(metrics_registry::triggers);
+        if (recipients.empty() && limited.empty()) {
+            server_.metrics.record(metrics_registry::fanout, 0);
+            return ;
+        }
+        if (!limited.empty()) {
+            /* an event is delivered once per recipient: immediately if it
+             * has an unlimited subscription matching, otherwise through its
+             * matching subscription having the smallest period */
+            std::sort(recipients.begin(), recipients.end());
+            std::sort(limited.begin(), limited.end());
+            auto last = std::unique(limited.begin(), limited.end(),
+                [&](const limited_delivery &a, const limited_delivery &b) {
+                    return a.recipient == b.recipient;
+                });
+            last = std::remove_if(limited.begin(), last,
+                [&](const limited_delivery &l) {
+                    return std::binary_search(
+                        recipients.begin(), recipients.end(), l.recipient);
+                });
+            limited.erase(last, limited.end());
+        }
+        auto fanout = recipients.size() + limited.size();
+        server_.metrics.add(metrics_registry::events_routed, fanout);
+        server_.metrics.record(metrics_registry::fanout, fanout);
+        if (server_.config.backpressure) {
+            for (auto &r: recipients)
+                hold_on(self, r);
+            for (auto &l: limited)
+                hold_on(self, l.recipient);
+        }
+        auto data = payload::format(
+            "EVENT ", trigger_xeidm.eid, '@', name(), '#', symbols().str(type_), '\n');
+        for (auto &l: limited)
+            l.recipient->async_trigger_limited(self, trigger_xeidm, data, l.subID);
+        if (recipients.empty())
+            return ;
+        event_trace_ptr trace;
+        if (auto period = server_.config.trace_sample_period) {
+            if (trace_countdown_ == 0) {
+                trace_countdown_ = period;
+                trace = std::make_shared<event_trace>(
+                    event_trace { read_time_, clock_type::now() });
+            }
+            --trace_countdown_;
+        }
+        post_by_shard(io_service_, recipients,
+            [self, trigger_xeidm, data, trace](const ptr &recipient) {
+                recipient->async_trigger(self, trigger_xeidm, data, trace);
+            });
+    }
+    
+    /**
+     * @brief suspends reading if a recipient of what this device sent is
+     * congested, async_release() resumes once they are all relieved.
+     * 
+     * @return bool true if suspended.
+     */
+    bool hold() {
+        if (holds_ == 0)
+            return false;
+        held_ = true;
+        async_println("PAUSE");
+        return true;
+    }
+    
+    /**
+     * @brief checks whether the queues of this device became congested, or
+     * were relieved, and releases the publishers paused on it.
+     * 
+     */
+    void update_congestion() {
+        auto limit = server_.config.max_queue_bytes;
+        if (!congested()) {
+            if (events_.above(0.5) || write_bytes_ > limit / 2)
+                congested_.store(true, std::memory_order_relaxed);
+        }
+        else if (!events_.above(0.25) && write_bytes_ <= limit / 4) {
+            congested_.store(false, std::memory_order_relaxed);
+            release_holding();
+        }
+    }
+    
+    /**
+     * @brief pauses this device until the recipient is relieved, if it's
+     * congested.
+     * 
+     */
+    void hold_on(const ptr &self, const ptr &recipient) {
+        if (!recipient->congested())
+            return ;
+        ++holds_;
+        recipient->async_hold(self);
+    }
+    
+    /**
+     * @brief releases the publishers paused on this device.
+     * 
+     */
+    void release_holding() {
+        for (auto &publisher: holding_)
+            publisher->async_release();
+        holding_.clear();
+    }
+    
+    /**
+     * @brief returns the key by which the events coalesce in the queue: the
+     * same eid triggered by the same device.
+     * 
+     */
+    std::uint64_t event_key(
+        const async_stream_protocol_base &trigging_device,
+        const xeid_matcher &trigger_xeidm) const {
+        const auto &config = server_.config;
+        if (config.queue_overflow != overflow_policy::coalesce &&
+            !config.paused_latest_per_eid)
+            return 0;
+        auto h = std::hash<std::string>()(trigger_xeidm.eid);
+        return h * 31 + std::hash<std::string>()(trigging_device.name());
+    }
+    
+    /**
+     * @brief queues an event, applying the overflow policy if it doesn't
+     * fit.
+     * the event is kept aside if the device is paused.
+     * 
+     */
+    void enqueue_event(buffer_ptr_type data, std::uint64_t key) {
+        if (overflowed_)
+            return ;    /* being stopped */
+        std::size_t dropped = 0;
+        if (paused_) {
+            paused_events_.push(std::move(data), key, dropped);
+            if (dropped)
+                server_.metrics.add(metrics_registry::events_dropped, dropped);
+            return ;
+        }
+        auto result = events_.push(std::move(data), key, dropped);
+        if (dropped)
+            server_.metrics.add(metrics_registry::events_dropped, dropped);
+        if (result == event_queue::overflow) {
+            overflowed_ = true;
+            server_.metrics.add(metrics_registry::overflows);
+            events_.clear();
+            async_stop();
+            return ;
+        }
+        update_congestion();
+    }
+    
+    /**
+     * @brief arranges the flush timer of the server to call async_flush()
+     * at the given time, unless it's already arranged earlier.
+     * 
+     */
+    void schedule_flush(clock_type::time_point due) {
+        if (flush_scheduled_ && flush_deadline_ <= due)
+            return ;
+        flush_scheduled_ = true;
+        flush_deadline_ = due;
+        auto &timers = server_.flush_timers;
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            due - clock_type::now());
+        std::uint64_t ticks = remaining.count() > 0 ? timers.ticks(remaining) : 0;
+        timers.schedule(
+            this->shared_from_this(),
+            timers.now() + std::max<std::uint64_t>(1, ticks));
+    }
+    
+    /**
+     * @brief delivers the kept events of the rate limited subscriptions
+     * whose period has passed, and arranges the next flush if others are
+     * left.
+     * 
+     */
+    void do_flush() {
+        flush_scheduled_ = false;
+        auto now = clock_type::now();
+        auto next = clock_type::time_point::max();
+        for (auto &p: rate_limits_) {
+            auto &limit = p.second;
+            if (!limit.pending)
+                continue;
+            auto due = limit.last_delivery + limit.minperiod;
+            if (due <= now) {
+                limit.last_delivery = now;
+                enqueue_event(std::move(limit.pending), limit.pending_key);
+            }
+            else if (due < next)
+                next = due;
+        }
+        do_write();
+        if (next != clock_type::time_point::max())
+            schedule_flush(next);
+    }
+    
+    /**
+     * @brief records the stages of a sampled event up to its queueing here,
+     * and keeps it until it's written. the oldest is forgotten beyond
+     * max_pending_traces, e.g. if the events are dropped.
+     * 
+     */
+    void start_trace(const buffer_ptr_type &data, const event_trace &trace) {
+        auto now = clock_type::now();
+        auto &metrics = server_.metrics;
+        metrics.record(metrics_registry::trace_route_ns, nanoseconds(trace.routed - trace.read));
+        metrics.record(metrics_registry::trace_dispatch_ns, nanoseconds(now - trace.routed));
+        if (traces_.size() == max_pending_traces)
+            traces_.erase(traces_.begin());
+        traces_.push_back({ data, trace.read, now });
+    }
+    
+    /**
+     * @brief moves the traces of the events in the write batch aside, until
+     * the write completes.
+     * 
+     */
+    void take_traces() {
+        auto it = std::stable_partition(traces_.begin(), traces_.end(),
+            [this](const pending_trace &t) {
+                return std::none_of(write_batch_.begin(), write_batch_.end(),
+                    [&t](const buffer_ptr_type &b) { return b.get() == t.data.get(); });
+            });
+        std::move(it, traces_.end(), std::back_inserter(traces_writing_));
+        traces_.erase(it, traces_.end());
+    }
+    
+    /**
+     * @brief records the write of the sampled events, and their whole trip
+     * from the read of their trig line.
+     * 
+     */
+    void finish_traces() {
+        auto now = clock_type::now();
+        auto &metrics = server_.metrics;
+        for (const auto &t: traces_writing_) {
+            metrics.record(metrics_registry::trace_write_ns, nanoseconds(now - t.enqueued));
+            metrics.record(metrics_registry::trace_total_ns, nanoseconds(now - t.read));
+        }
+        traces_writing_.clear();
+    }
+    
+    static std::uint64_t nanoseconds(clock_type::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+    
+    /**
+     * @brief writes everything queued, up to the configured limits, with a
+     * single write operation. the replies go before the events, the events
+     * kept while paused are written all at once after continue.
+     * 
+     */
     void do_write() {
-        if (write_queue_.empty())
+        bool replay = !paused_ && !paused_events_.empty();
+        if (writing_ || (write_queue_.empty() && events_.empty() && !replay))
             return ;
-        auto first = write_queue_.front();
-        write_queue_.pop_front();
-        boost::asio::async_write(s_, buffer(*first), wrap(
-            [this, first /* must hold ! */, c = this->shared_from_this()](
+        const auto &config = server_.config;
+        std::size_t bytes = 0;
+        auto queued = write_queue_.size() + events_.size() + (replay ? paused_events_.size() : 0);
+        auto fits = [&](const buffer_ptr_type &next) {
+            return write_batch_.size() < config.max_write_buffers &&
+                (write_batch_.empty() || bytes + next->size() <= config.max_write_bytes);
+        };
+        while (!write_queue_.empty() && fits(write_queue_.front())) {
+            bytes += write_queue_.front()->size();
+            write_bytes_ -= write_queue_.front()->size();
+            write_batch_.push_back(std::move(write_queue_.front()));
+            write_queue_.pop_front();
+        }
+        /* the events wait for the rest of the write queue, they mustn't come
+         * between the header of a p2p piece and its data */
+        if (write_queue_.empty()) {
+            while (replay && !paused_events_.empty()) {
+                bytes += paused_events_.front()->size();
+                write_batch_.push_back(paused_events_.pop());
+            }
+            while (!events_.empty() && fits(events_.front())) {
+                bytes += events_.front()->size();
+                write_batch_.push_back(events_.pop());
+            }
+        }
+        update_congestion();
+        if (!traces_.empty())
+            take_traces();
+        auto &metrics = server_.metrics;
+        metrics.add(metrics_registry::writes);
+        metrics.add(metrics_registry::write_buffers, write_batch_.size());
+        metrics.record(metrics_registry::write_queue_depth, queued);
+        writing_ = true;
+        
+        auto handler = wrap(
+            [this, c = this->shared_from_this()](
                 const error_code &ec,
                 std::size_t bytes_transferred) {
-                if (ec)
+                writing_ = false;
+                write_batch_.clear();   /* must hold until now ! */
+                server_.metrics.add(metrics_registry::bytes_out, bytes_transferred);
+                if (ec) {
                     // most probably boost::asio::error::operation_aborted
+                    stream_error(ec);
                     return ;
+                }
+                if (!traces_writing_.empty())
+                    finish_traces();
                 do_write();
-        }));
+        });
+        if (is_ssl_stream<std::decay_t<AsyncStream>>::value) {
+            /* ssl::stream encrypts the buffers of a sequence one by one,
+             * one record each, so the batch is written from a single
+             * contiguous buffer instead */
+            write_linear_.clear();
+            for (const auto &b: write_batch_)
+                write_linear_.insert(write_linear_.end(), b->begin(), b->end());
+            boost::asio::async_write(s_, buffer(write_linear_), std::move(handler));
+        }
+        else {
+            write_gather_.clear();
+            for (const auto &b: write_batch_)
+                write_gather_.push_back(buffer(b->data(), b->size()));
+            boost::asio::async_write(s_, write_gather_, std::move(handler));
+        }
     }
 };
 
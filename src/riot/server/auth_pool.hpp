@@ -0,0 +1,134 @@
+#ifndef AUTH_POOL_HPP_INCLUDED
+#define AUTH_POOL_HPP_INCLUDED
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <boost/asio.hpp>
+
+namespace riot { namespace server {
+
+using namespace boost::asio;
+
+/**
+ * @brief worker threads authenticating the logins, so that checking the
+ * credentials never blocks the threads serving the sessions.
+ *
+ * the requests submitted meanwhile are processed together, in batches of
+ * up to max_batch: the batch function checks them one by one, but it can
+ * register them into the shared structures at once and carry the results
+ * back to each io_service with a single handler, see post_by_shard().
+ *
+ * @param Request type of the requests, e.g. a pointer to the session.
+ */
+template <typename Request>
+class auth_pool {
+public:
+    /**
+     * @brief processes a batch, called on a worker thread with the
+     * io_service of the workers.
+     *
+     */
+    using batch_function = std::function<void(std::vector<Request> &, io_service &)>;
+
+    static constexpr std::size_t max_batch = 256;
+
+    explicit auth_pool(batch_function process) :
+        process_(std::move(process))
+    {}
+
+    auth_pool(const auth_pool &) = delete;
+    auth_pool &operator=(const auth_pool &) = delete;
+
+    /**
+     * @brief destructor, stops the workers. the requests not processed yet
+     * are dropped.
+     *
+     */
+    ~auth_pool() {
+        stop();
+    }
+
+    /**
+     * @brief starts the workers, only the first call has an effect. the
+     * servers sharing the pool all call it when they start.
+     *
+     * @param threads number of the workers, at least 1.
+     */
+    void start(std::size_t threads) {
+        std::call_once(started_, [this, threads] {
+            work_ = std::make_unique<io_service::work>(io_service_);
+            for (std::size_t i = 0; i < std::max<std::size_t>(1, threads); ++i)
+                threads_.emplace_back([this] { io_service_.run(); });
+        });
+    }
+
+    /**
+     * @brief stops the workers and waits for them.
+     *
+     */
+    void stop() {
+        work_.reset();
+        io_service_.stop();
+        for (auto &t: threads_)
+            if (t.joinable())
+                t.join();
+    }
+
+    /**
+     * @brief queues a request, a worker takes it with the other pending
+     * ones. it's thread safe.
+     *
+     */
+    void submit(Request request) {
+        bool schedule;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(std::move(request));
+            schedule = !scheduled_;
+            scheduled_ = true;
+        }
+        if (schedule)
+            io_service_.post([this] { drain(); });
+    }
+private:
+    batch_function process_;
+    io_service io_service_;
+    std::unique_ptr<io_service::work> work_;
+    std::vector<std::thread> threads_;
+    std::once_flag started_;
+
+    std::mutex mutex_;
+    std::vector<Request> pending_;
+    bool scheduled_ { false };     /* a drain is posted and hasn't taken them */
+
+    void drain() {
+        std::vector<Request> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_.size() <= max_batch) {
+                batch.swap(pending_);
+                scheduled_ = false;
+            }
+            else {
+                /* the rest goes to another worker, if one is idle */
+                auto end = pending_.begin() + max_batch;
+                batch.assign(
+                    std::make_move_iterator(pending_.begin()),
+                    std::make_move_iterator(end));
+                pending_.erase(pending_.begin(), end);
+                io_service_.post([this] { drain(); });
+            }
+        }
+        if (!batch.empty())
+            process_(batch, io_service_);
+    }
+};
+
+}}
+
+#endif // AUTH_POOL_HPP_INCLUDED
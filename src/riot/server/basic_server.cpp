@@ -2,20 +2,28 @@
 
 namespace riot { namespace server {
 
-basic_server::basic_server(io_service& io_service, short port) :
+basic_server::basic_server(
+    io_service& io_service,
+    short port,
+    shared_state_ptr shared) :
     server_common<
-        async_stream_protocol<tcp::socket, basic_server>>(io_service),
-    acceptor_(io_service, tcp::endpoint(ip::tcp::v4(), port)),
+        async_stream_protocol<tcp::socket, basic_server>>(io_service, shared),
+    acceptor_(open_acceptor(io_service, port, shared != nullptr)),
     socket_(io_service)
 {
 }
 
 void basic_server::start()
 {
+    idle_timers.start(std::chrono::milliseconds(config.idle_timer_resolution));
+    flush_timers.start(std::chrono::milliseconds(config.flush_timer_resolution));
+    authenticator.start(config.auth_threads);
     do_accept();
 }
 
 void basic_server::stop() {
+    idle_timers.stop();
+    flush_timers.stop();
     post([this] {
         acceptor_.cancel();
         for_each_session([this](auto session, bool remove) {
@@ -33,10 +41,14 @@ void basic_server::do_accept()
             // most probably boost::asio::error::operation_aborted
             return ;
         }
+        /* do_write already coalesces the replies and the events, Nagle
+         * would only hold them until the delayed ack of the device */
+        socket_.set_option(tcp::no_delay(true));
+        metrics.add(metrics_registry::accepts);
         auto protocol = std::make_shared<
                         async_stream_protocol<tcp::socket, basic_server>>(
             io_service_, std::move(socket_), *this);
-        sessions.push_back(protocol);
+        post([this, protocol] { add_session(protocol); });
         protocol->start();
         socket_ = tcp::socket(io_service_);
         do_accept();
@@ -18,9 +18,18 @@ class basic_server :
 {
 
 public:
+    /**
+     * @brief constructor.
+     * 
+     * @param io_service io_service serving the accepted connections.
+     * @param port port to listen on.
+     * @param shared state shared with the other servers of a server_pool,
+     * which listen on the same port. null for a standalone server.
+     */
     basic_server(
         io_service &io_service,
-        short port);
+        short port,
+        shared_state_ptr shared = nullptr);
     
     void start();
     
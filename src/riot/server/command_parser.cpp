@@ -1,16 +1,96 @@
-#include <sstream>
 #include <stdexcept>
 #include <utility>
-#include <regex>
+#include <charconv>
 
 #include <src/riot/server/header_parser.hpp>
 #include <src/riot/server/command_parser.hpp>
+#include <src/riot/server/tokenizer.hpp>
 
 using namespace std;
 
 namespace riot { namespace server {
 
-bool command_parser::parse(const std::string &line) {
+namespace {
+
+/* parses the whole token as an unsigned integer */
+bool to_uint(string_view token, uint64_t &value) {
+    if (token.empty())
+        return false;
+    auto result = from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == errc() && result.ptr == token.data() + token.size();
+}
+
+/* parses a comma separated list of integers */
+bool to_uint_list(string_view token, command_parser::id_list &values) {
+    while (true) {
+        auto comma = token.find(',');
+        uint64_t value;
+        if (!to_uint(token.substr(0, comma), value))
+            return false;
+        values.push_back(value);
+        if (comma == string_view::npos)
+            return true;
+        token.remove_prefix(comma + 1);
+    }
+}
+
+/* "key=value" arguments, returns false if token doesn't start with "key=" */
+bool key_value(string_view token, string_view key, string_view &value) {
+    if (token.size() <= key.size() ||
+        token.compare(0, key.size(), key) != 0 ||
+        token[key.size()] != '=')
+        return false;
+    value = token.substr(key.size() + 1);
+    return true;
+}
+
+command_parser::type_t keyword(string_view word) {
+    switch (word.size()) {
+    case 3:
+        if (word == "sub") return command_parser::sub;
+        break;
+    case 4:
+        if (word == "trig") return command_parser::trig;
+        break;
+    case 5:
+        if (word == "unsub") return command_parser::unsub;
+        if (word == "pause") return command_parser::pause;
+        break;
+    case 6:
+        if (word == "negsub") return command_parser::negsub;
+        break;
+    case 8:
+        if (word == "unnegsub") return command_parser::unnegsub;
+        if (word == "continue") return command_parser::cont;
+        break;
+    case 10:
+        if (word == "p2p-accept") return command_parser::p2p_accept;
+        break;
+    case 14:
+        if (word == "p2p-disconnect") return command_parser::p2p_disconnect;
+        break;
+    case 15:
+        if (word == "p2p-stop-accept") return command_parser::p2p_stop_accept;
+        break;
+    }
+    return command_parser::invalid;
+}
+
+}
+
+command_parser::command_parser(std::pmr::memory_resource *resource) :
+    error_msg_(resource)
+{
+    /* not by aggregate initialization of s, which would zero the inline
+     * storage of the lists */
+    for (auto *xeids: { &s.trig.xeids, &s.sub.xeids, &s.negsub.xeids })
+        xeids->reset(resource);
+    for (auto *ids: { &s.unsub.subIDs, &s.unnegsub.negsubIDs,
+                      &s.p2p.disconnect.p2pIDs, &s.p2p.send.p2pIDs })
+        ids->reset(resource);
+}
+
+bool command_parser::parse(string_view line) {
     // BEGIN error messages
     // static const char *err_not_enough_args      = "not enough arguments";
     static const char *err_too_many_args        = "too many arguments";
@@ -20,97 +100,75 @@ bool command_parser::parse(const std::string &line) {
     static const char *err_invalid_command      = "not a valid command";
     static const char *err_emptyline            = "empty line";
     // END
-    static regex rgx_p2p_send {R"((\d+(?:,\d+)*|\*)>(\d+|n|N))"};
-    
-    error_msg_ = "";
-    istringstream iss(line);
-    string dummy;
-    if (iss >> dummy) {
-        if (dummy == "trig") {
-            type_ = trig;
-            /* trig (<xeid>)*  */
-            while (iss >> dummy) {
-                xeid_matcher xeidm;
-                try {
-                    xeidm.init(dummy);
-                    s.trig.xeids.push_back(std::move(xeidm));
-                }
-                catch (std::exception &ex) {
-                    set_error_msg(err_invalid_xeid, " : ", ex.what());
-                    break;
-                }
+
+    error_msg_.clear();
+    string_view rest = line;
+    string_view command = next_token(rest);
+    if (command.empty()) {
+        set_error_msg(err_emptyline);
+        type_ = empty;
+        return false;
+    }
+
+    /* parses (<xeid>)* into xeids */
+    auto parse_xeids = [&](xeid_list &xeids) {
+        xeids.clear();
+        for (auto token = next_token(rest); !token.empty(); token = next_token(rest)) {
+            try {
+                xeids.emplace_back(token);
+            }
+            catch (std::exception &ex) {
+                set_error_msg(err_invalid_xeid, " : ", ex.what());
+                break;
             }
         }
-        else if (dummy == "sub") {
-            type_ = sub;
-            /* reset first */
-            s.sub.minperiod_exists = false;
-            /* sub (<xeid>)* (minperiod=<timeout>)? */
-            while (iss >> dummy) {
-                xeid_matcher xeidm;
-                try {
-                    xeidm.init(dummy);
-                    s.sub.xeids.push_back(std::move(xeidm));
-                }
-                catch (std::exception &ex) {
-                    istringstream iss(dummy);
-                    getline(iss, dummy, '=');
-                    if (dummy == "minperiod") {
-                        if (iss >> dummy /* iss has no whitespace, dummy is what is left */) {
-                            if (header_parser::string_to_timeout(
-                                dummy,
-                                s.sub.minperiod_exists,
-                                s.sub.minperiod)) {
-                                /* fine */
-                            }
-                            else {
-                                set_error_msg(err_invalid_arg, " : ", dummy);
-                                break;
-                            }
-                        }
-                        else {
-                            set_error_msg(err_invalid_arg, " : ", dummy);
-                            break;
-                        }
-                    }
-                    else {
-                        set_error_msg(err_invalid_arg, " : ", dummy);
-                        break;
-                    }
-                }
+    };
+
+    /* parses (ID)* \*? into ids and all */
+    auto parse_ids = [&](id_list &ids, bool &all) {
+        ids.clear();
+        all = false;
+        for (auto token = next_token(rest); !token.empty(); token = next_token(rest)) {
+            uint64_t id;
+            if (token == "*") {
+                all = true;
+                break;
+            }
+            else if (to_uint(token, id)) {
+                ids.push_back(id);
+            }
+            else {
+                set_error_msg(err_invalid_arg, " : ", token);
+                break;
             }
         }
-        else if (dummy == "unsub") {
-            type_ = unsub;
-            /* reset first */
-            s.unsub.all = false;
-            /* unsub (subID)* \*? */
-            while (iss >> dummy) {
-                if (dummy == "*") {
-                    s.unsub.all = true;
+    };
+
+    type_ = keyword(command);
+    switch (type_) {
+    case trig:
+        /* trig (<xeid>)*  */
+        parse_xeids(s.trig.xeids);
+        break;
+    case sub: {
+        /* sub (<xeid>)* (minperiod=<timeout>)? */
+        s.sub.xeids.clear();
+        s.sub.minperiod_exists = false;
+        for (auto token = next_token(rest); !token.empty(); token = next_token(rest)) {
+            string_view value;
+            if (key_value(token, "minperiod", value)) {
+                /* checked first, "minperiod=..." is a valid xeid too */
+                if (!header_parser::string_to_timeout(
+                    value,
+                    s.sub.minperiod_exists,
+                    s.sub.minperiod)) {
+                    set_error_msg(err_invalid_arg, " : ", token);
                     break;
                 }
-                else {
-                    istringstream iss(dummy);
-                    uint64_t subID;
-                    if (iss >> subID) {
-                        s.unsub.subIDs.push_back(subID);
-                    }
-                    else {
-                        set_error_msg(err_invalid_arg, " : ", dummy);
-                        break;
-                    }
-                }
             }
-        }
-        else if (dummy == "negsub") {
-            type_ = negsub;
-            /* negsub (<xeid>)* */
-            while (iss >> dummy) {
-                xeid_matcher xeidm;
+            else {
                 try {
-                    xeidm.init(dummy);
-                    s.negsub.xeids.push_back(std::move(xeidm));
+                    s.sub.xeids.emplace_back(token);
                 }
                 catch (std::exception &ex) {
                     set_error_msg(err_invalid_xeid, " : ", ex.what());
@@ -118,150 +176,96 @@ bool command_parser::parse(const std::string &line) {
                 }
             }
         }
-        else if (dummy == "unnegsub") {
-            type_ = unnegsub;
-            /* reset first */
-            s.unnegsub.all = false;
-            /* unnegsub (subID)* \*? */
-            while (iss >> dummy) {
-                if (dummy == "*") {
-                    s.unnegsub.all = true;
-                    break;
-                }
-                else {
-                    istringstream iss(dummy);
-                    uint64_t negsubID;
-                    if (iss >> negsubID) {
-                        s.unnegsub.negsubIDs.push_back(negsubID);
-                    }
-                    else {
-                        set_error_msg(err_invalid_arg, " : ", dummy);
-                        break;
-                    }
-                }
-            }
-        }
-        else if (dummy == "pause") {
-            type_ = pause;
-            /* pause */
-        }
-        else if (dummy == "continue") {
-            type_ = cont;
-            /* continue */
-        }
-        else if (dummy == "p2p-accept") {
-            type_ = p2p_accept;
-            /* reset first */
-            s.p2p.accept.maxconnections_exists = false;
-            /* p2p-accept (maxconnections=N)? */
-            if (iss >> dummy) {
-                istringstream iss(dummy);
-                getline(iss, dummy, '=');
-                if (dummy == "maxconnections") {
-                    if (iss >> dummy) {
-                        istringstream iss(dummy);
-                        if (iss >> s.p2p.accept.maxconnections) {
-                            s.p2p.accept.maxconnections_exists = true;
-                        }
-                        else {
-                            set_error_msg(err_invalid_arg, " : ", dummy);
-                        }
-                    }
-                    else {
-                        set_error_msg(err_invalid_arg, " : ", dummy);
-                    }
-                }
-                else {
-                    set_error_msg(err_invalid_arg, " : ", dummy);
-                }
+        break;
+    }
+    case unsub:
+        /* unsub (subID)* \*? */
+        parse_ids(s.unsub.subIDs, s.unsub.all);
+        break;
+    case negsub:
+        /* negsub (<xeid>)* */
+        parse_xeids(s.negsub.xeids);
+        break;
+    case unnegsub:
+        /* unnegsub (negsubID)* \*? */
+        parse_ids(s.unnegsub.negsubIDs, s.unnegsub.all);
+        break;
+    case pause:
+        /* pause */
+        break;
+    case cont:
+        /* continue */
+        break;
+    case p2p_accept: {
+        /* p2p-accept (maxconnections=N)? */
+        s.p2p.accept.maxconnections_exists = false;
+        auto token = next_token(rest);
+        if (!token.empty()) {
+            string_view value;
+            if (key_value(token, "maxconnections", value) &&
+                to_uint(value, s.p2p.accept.maxconnections)) {
+                s.p2p.accept.maxconnections_exists = true;
             }
             else {
-                /* argument is optional */
-            }
-        }
-        else if (dummy == "p2p-stop-accept") {
-            type_ = p2p_stop_accept;
-            /* p2p-stop-accept */
-        }
-        else if (dummy == "p2p-disconnect") {
-            type_ = p2p_disconnect;
-            /* reset first */
-            s.p2p.disconnect.all = false;
-            /* p2p-disconnect (p2pID)* \*? */
-            while (iss >> dummy) {
-                if (dummy == "*") {
-                    s.p2p.disconnect.all = true;
-                    break;
-                }
-                else {
-                    istringstream iss(dummy);
-                    uint64_t p2pID;
-                    if (iss >> p2pID) {
-                        s.p2p.disconnect.p2pIDs.push_back(p2pID);
-                    }
-                    else {
-                        set_error_msg(err_invalid_arg, " : ", dummy);
-                    }
-                }
+                set_error_msg(err_invalid_arg, " : ", token);
             }
         }
         else {
-            smatch match;
-            if (regex_match(dummy, match, rgx_p2p_send)) {
-                /* if not a command, can be send */
-                /* reset first */
-                s.p2p.send.all = false;
-                s.p2p.send.until_newline = false;
-                /* N1,N2,...,Nn>B */
-                type_ = p2p_send;
-                string m1 = match[1], m2 = match[2];
-                if (m1 == "*")
-                {
-                    s.p2p.send.all = true;
-                }
-                else
-                {
-                    istringstream iss(m1);
-                    uint64_t p2pID;
-                    while (iss >> p2pID) {
-                        s.p2p.send.p2pIDs.push_back(p2pID);
-                        char c; iss >> c; // skip ","
-                    }
-                }
-                
-                if (m2 == "n" || m2 == "N") {
-                    s.p2p.send.until_newline = true;
-                }
-                else {
-                    istringstream iss(m2);
-                    iss >> s.p2p.send.size;
-                }
-            }
-            else {
-                set_error_msg(err_invalid_command);
-            }
+            /* argument is optional */
         }
-        
-        /* if no error message is set, it's still possible to have too many arguments */
-        if (error_msg_.empty() /* dont override previous error */ && iss >> dummy) {
-            set_error_msg(err_too_many_args);
-            type_ = invalid;
-            return false;
+        break;
+    }
+    case p2p_stop_accept:
+        /* p2p-stop-accept */
+        break;
+    case p2p_disconnect:
+        /* p2p-disconnect (p2pID)* \*? */
+        parse_ids(s.p2p.disconnect.p2pIDs, s.p2p.disconnect.all);
+        break;
+    default: {
+        /* if not a command, can be send: (\d+(?:,\d+)*|\*)>(\d+|n|N) */
+        auto gt = command.find('>');
+        if (gt == string_view::npos) {
+            set_error_msg(err_invalid_command);
+            break;
         }
-        
-        /* if error message is set, return false */
-        if (!error_msg_.empty()) {
-            type_ = invalid;
-            return false;
+        string_view targets = command.substr(0, gt);
+        string_view size = command.substr(gt + 1);
+        s.p2p.send.p2pIDs.clear();
+        s.p2p.send.all = false;
+        s.p2p.send.until_newline = false;
+        s.p2p.send.size = 0;
+        bool fine = true;
+        if (targets == "*")
+            s.p2p.send.all = true;
+        else
+            fine = to_uint_list(targets, s.p2p.send.p2pIDs);
+        if (size == "n" || size == "N")
+            s.p2p.send.until_newline = true;
+        else
+            fine = fine && to_uint(size, s.p2p.send.size);
+        if (fine) {
+            type_ = p2p_send;
         }
-        
-        return true;
+        else {
+            set_error_msg(err_invalid_command);
+        }
+        break;
     }
-    else {
-        set_error_msg(err_emptyline);
-        type_ = empty;
+    }
+
+    /* if no error message is set, it's still possible to have too many arguments */
+    if (error_msg_.empty() /* dont override previous error */ && !next_token(rest).empty()) {
+        set_error_msg(err_too_many_args);
+    }
+
+    /* if error message is set, return false */
+    if (!error_msg_.empty()) {
+        type_ = invalid;
         return false;
     }
+
+    return true;
 }
 
 }}
@@ -1,14 +1,20 @@
 #ifndef COMMAND_PARSER_INCLUDED
 #define COMMAND_PARSER_INCLUDED
 
-#include <list>
+#include <string>
+#include <string_view>
+#include <memory_resource>
 #include <cstdint>
 
 #include <src/riot/server/xeid_matcher.hpp>
+#include <src/riot/server/small_vector.hpp>
 
 namespace riot { namespace server {
 
 struct command_parser {
+    using xeid_list = small_vector<xeid_matcher, 4>;
+    using id_list = small_vector<std::uint64_t, 8>;
+    
     enum type_t {
         empty = -2, // might help a little?
         invalid = -1,
@@ -25,30 +31,40 @@ struct command_parser {
         p2p_send
     };
     
+    /**
+     * @brief constructor.
+     * 
+     * @param resource memory of the lists beyond their inline capacity and
+     * of the error message, must outlive the parser. the strings of the
+     * parsed xeids don't come from it, the subscriptions take them.
+     */
+    explicit command_parser(
+        std::pmr::memory_resource *resource = std::pmr::new_delete_resource());
+    
     type_t type() const
     { return type_; }
     
     std::string error_msg() const
-    { return error_msg_; }
+    { return std::string(error_msg_); }
     
     struct {
         struct {
-            std::list<xeid_matcher> xeids;
+            xeid_list xeids;
         } trig;
         struct {
-            std::list<xeid_matcher> xeids;
+            xeid_list xeids;
             bool minperiod_exists {false};
             std::uint64_t minperiod { static_cast<std::uint64_t>(1e6) } /* in ms */;
         } sub;
         struct {
-            std::list<uint64_t> subIDs;
+            id_list subIDs;
             bool all {false};
         } unsub;
         struct {
-            std::list<xeid_matcher> xeids;
+            xeid_list xeids;
         } negsub;
         struct {
-            std::list<uint64_t> negsubIDs;
+            id_list negsubIDs;
             bool all {false};
         } unnegsub;
         struct {
@@ -66,11 +82,11 @@ struct command_parser {
                 /* empty */
             } stop_accept;
             struct {
-                std::list<uint64_t> p2pIDs;
+                id_list p2pIDs;
                 bool all {false};
             } disconnect;
             struct {
-                std::list<uint64_t> p2pIDs;
+                id_list p2pIDs;
                 std::uint64_t size {0};
                 bool all {false};
                 bool until_newline {false};
@@ -81,21 +97,22 @@ struct command_parser {
     /**
      * @brief parses the given line, returns true if success, false otherwise
      * 
+     * the line is tokenized in place, nothing but the parsed xeids is
+     * copied out of it.
+     * 
      * @param line line
      * @return bool
      */
-    bool parse(const std::string &line);
+    bool parse(std::string_view line);
 private:
-    type_t type_;
-    std::string error_msg_;
+    type_t type_ { empty };
+    std::pmr::string error_msg_;
  
+    /* the pieces are strings */
     template <typename ...T>
     void set_error_msg(T && ...t) {
-        std::ostringstream oss;
-        oss << "syntax error: ";
-        using helper_t = int [];
-        (void) helper_t { 0, ( oss << t, 0 ) ... };
-        error_msg_ = oss.str();
+        error_msg_.assign("syntax error: ");
+        (error_msg_.append(std::string_view(t)), ...);
     }
 };
 
@@ -2,21 +2,156 @@
 #define _CONFIGURATION_INCLUDED
 
 #include <string>
+#include <string_view>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <src/riot/server/credential_store.hpp>
 
 namespace riot { namespace server {
 
+/**
+ * @brief what to do with the events of a session whose queue is full.
+ *
+ */
+enum class overflow_policy {
+    drop_oldest,    /* the oldest queued events make room */
+    drop_newest,    /* the new event is dropped */
+    coalesce,       /* the new event replaces the queued one of the same eid and device */
+    disconnect      /* the session is closed */
+};
+
 class server_configuration {
 
 public:
 
+    /**
+     * @brief size of the chunks read from the connections.
+     * 
+     */
+    std::size_t read_buffer_size { 4096 };
+    
+    /**
+     * @brief maximum length of a line, reading stops on longer lines.
+     * 
+     */
+    std::size_t max_line_length { 65536 };
+    
+    /**
+     * @brief upper limits on a single write operation, everything queued
+     * for a session is written at once within these limits.
+     * 
+     */
+    std::size_t max_write_bytes { 65536 };
+    std::size_t max_write_buffers { 64 };
+    
+    /**
+     * @brief resolution of the idle timeouts of the sessions, in ms.
+     * 
+     */
+    std::uint64_t idle_timer_resolution { 1000 };
+    
+    /**
+     * @brief resolution of the flushes of the rate limited subscriptions
+     * (sub ... minperiod=), in ms.
+     * 
+     */
+    std::uint64_t flush_timer_resolution { 10 };
+
+    /**
+     * @brief number of the threads checking the credentials of the logins,
+     * besides the threads serving the sessions.
+     * 
+     */
+    std::size_t auth_threads { 2 };
+
+    /**
+     * @brief limits on the events queued for a session which doesn't read
+     * them fast enough, and what happens beyond.
+     * 
+     */
+    std::size_t max_queue_bytes { 1 << 20 };
+    std::size_t max_queue_messages { 4096 };
+    overflow_policy queue_overflow { overflow_policy::drop_oldest };
+
+    /**
+     * @brief maximum number of the events kept for a paused session (from
+     * pause to continue), the oldest are dropped beyond. only the latest
+     * event of each eid and device is kept with paused_latest_per_eid.
+     * 
+     */
+    std::size_t max_paused_events { 4096 };
+    bool paused_latest_per_eid { false };
+
+    /**
+     * @brief size of the pieces in which the p2p transfers are read and
+     * forwarded, each piece is read once and shared by the recipients.
+     * 
+     */
+    std::size_t p2p_chunk_size { 256 * 1024 };
+
+    /**
+     * @brief pauses reading a publisher while one of the recipients of its
+     * events is congested (its queues filled beyond the half), the publisher
+     * gets PAUSE and CONTINUE. off by default, a subscriber which stops
+     * reading would stop its publishers. p2p transfers are always paused
+     * this way.
+     * 
+     */
+    bool backpressure { false };
+
+    /**
+     * @brief traces one in trace_sample_period of the events triggered by
+     * each device, timing its stages from the read of the trig line to the
+     * write to each recipient, see metrics_registry. 0 disables the tracing,
+     * which costs a branch per read then. the events delivered through a
+     * minperiod subscription are not traced.
+     * 
+     */
+    std::uint64_t trace_sample_period { 0 };
+
+    /**
+     * @brief tls session resumption (ssl servers only): number of the
+     * sessions cached by id (0 for none), lifetime of a session in s, and
+     * resumption from tickets, sealed by a key renewed every
+     * tls_ticket_key_lifetime s. the tickets of the tls_ticket_keys - 1
+     * previous keys are still accepted.
+     * 
+     */
+    std::size_t tls_session_cache_size { 20480 };
+    std::uint64_t tls_session_timeout { 7200 };
+    bool tls_tickets { true };
+    std::uint64_t tls_ticket_key_lifetime { 3600 };
+    std::size_t tls_ticket_keys { 3 };
+    
+    /**
+     * @brief keeps resumable the tls sessions of the connections dropped
+     * without close_notify, as most devices do, instead of removing them
+     * from the session cache as openssl does. the sessions of the
+     * connections closed in an orderly way are always kept.
+     * 
+     */
+    bool tls_resume_unclean { false };
+
+    /**
+     * @brief passwords of the devices. without them, every device is
+     * trusted and may log in more than once.
+     * 
+     */
+    std::shared_ptr<credential_store> credentials;
+
     bool check_credentials(
-        const std::string &name,
-        const std::string &password,
+        std::string_view name,
+        std::string_view type,
+        std::string_view password,
         bool &multiple_login_allowed)
     {
-        // temporarily
-        multiple_login_allowed = true;
-        return true;
+        if (!credentials) {
+            multiple_login_allowed = true;
+            return true;
+        }
+        return credentials->check(name, type, password, multiple_login_allowed);
     }
 
 };
@@ -0,0 +1,271 @@
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <charconv>
+#include <memory>
+#include <unordered_map>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <src/riot/server/credential_store.hpp>
+
+using namespace std;
+
+namespace riot { namespace server {
+
+namespace {
+
+const char *hash_scheme = "pbkdf2-sha256";
+
+string to_hex(const string &bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    string result;
+    for (unsigned char c: bytes) {
+        result += digits[c >> 4];
+        result += digits[c & 15];
+    }
+    return result;
+}
+
+bool from_hex(string_view hex, string &bytes)
+{
+    if (hex.size() % 2 != 0)
+        return false;
+    bytes.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        unsigned value;
+        auto result = from_chars(hex.data() + i, hex.data() + i + 2, value, 16);
+        if (result.ec != errc() || result.ptr != hex.data() + i + 2)
+            return false;
+        bytes += static_cast<char>(value);
+    }
+    return true;
+}
+
+string derive(string_view password, const string &salt, unsigned iterations, size_t size)
+{
+    string result(size, '\0');
+    PKCS5_PBKDF2_HMAC(
+        password.data(), password.size(),
+        reinterpret_cast<const unsigned char *>(salt.data()), salt.size(),
+        iterations, EVP_sha256(),
+        size, reinterpret_cast<unsigned char *>(&result[0]));
+    return result;
+}
+
+/* key of the digests remembered by the cache, so that they are useless
+ * outside of this process */
+const array<unsigned char, 32> &cache_key()
+{
+    static const auto key = [] {
+        array<unsigned char, 32> k;
+        RAND_bytes(k.data(), k.size());
+        return k;
+    }();
+    return key;
+}
+
+/* sha256(cache key, salt, password), on a context of the thread: the
+ * one-shot HMAC() fetches its algorithms on each call, which costs ten times
+ * the digest of a password */
+void cache_digest(const string &salt, string_view password, unsigned char *out)
+{
+    static EVP_MD *md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    thread_local unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX *)> ctx(
+        EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    auto &key = cache_key();
+    unsigned int size;
+    EVP_DigestInit_ex(ctx.get(), md, nullptr);
+    EVP_DigestUpdate(ctx.get(), key.data(), key.size());
+    EVP_DigestUpdate(ctx.get(), salt.data(), salt.size());
+    EVP_DigestUpdate(ctx.get(), password.data(), password.size());
+    EVP_DigestFinal_ex(ctx.get(), out, &size);
+}
+
+size_t hash_of(string_view key)
+{
+    return std::hash<string_view>()(key);
+}
+
+}
+
+const credential_store::entry *credential_store::table::find(string_view key, uint32_t &index) const
+{
+    if (slots.empty())
+        return nullptr;
+    for (size_t i = hash_of(key) & mask;; i = (i + 1) & mask) {
+        auto slot = slots[i];
+        if (slot == 0)
+            return nullptr;
+        if (entries[slot - 1].key == key) {
+            index = slot - 1;
+            return &entries[slot - 1];
+        }
+    }
+}
+
+void credential_store::table::build()
+{
+    size_t size = 16;
+    while (size < entries.size() * 2)
+        size *= 2;
+    slots.assign(size, 0);
+    mask = size - 1;
+    for (uint32_t index = 0; index < entries.size(); ++index) {
+        size_t i = hash_of(entries[index].key) & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = index + 1;
+    }
+}
+
+bool credential_store::load(const string &path, string &error)
+{
+    ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    if (!load(in, error))
+        return false;
+    lock_guard<mutex> lock(reload_mutex_);
+    path_ = path;
+    return true;
+}
+
+bool credential_store::reload(string &error)
+{
+    string path;
+    {
+        lock_guard<mutex> lock(reload_mutex_);
+        path = path_;
+    }
+    if (path.empty()) {
+        error = "no credentials file";
+        return false;
+    }
+    return load(path, error);
+}
+
+bool credential_store::load(istream &in, string &error)
+{
+    // BEGIN error messages
+    static const char *err_invalid_kind         = "expected device or type";
+    static const char *err_not_enough_args      = "not enough arguments";
+    static const char *err_invalid_hash         = "not a valid hash";
+    static const char *err_invalid_arg          = "not a valid argument";
+    // END
+    auto next = make_unique<table>();
+    unordered_map<string, size_t> positions;   /* of the keys in entries */
+    string line;
+    for (size_t nline = 1; getline(in, line); ++nline) {
+        istringstream iss(line);
+        string kind, key, hash, flag;
+        if (!(iss >> kind) || kind[0] == '#')
+            continue;
+        auto fail = [&](const char *msg) {
+            error = "line " + to_string(nline) + ": " + msg;
+            return false;
+        };
+        if (kind != "device" && kind != "type")
+            return fail(err_invalid_kind);
+        if (!(iss >> key >> hash))
+            return fail(err_not_enough_args);
+        entry e { string(1, kind[0]) + key, hash == "*", false, 0, {}, {} };
+        if (iss >> flag) {
+            if (flag != "multiple")
+                return fail(err_invalid_arg);
+            e.multiple_login = true;
+        }
+        if (!e.open) {
+            /* pbkdf2-sha256:<iterations>:<salt>:<derived> */
+            string_view h(hash);
+            auto a = h.find(':'), b = h.find(':', a + 1), c = h.find(':', b + 1);
+            uint64_t iterations = 0;
+            bool fine = c != string_view::npos &&
+                h.substr(0, a) == hash_scheme &&
+                from_chars(h.data() + a + 1, h.data() + b, iterations).ptr == h.data() + b &&
+                iterations > 0 && iterations <= 0xffffffffu &&
+                from_hex(h.substr(b + 1, c - b - 1), e.salt) &&
+                from_hex(h.substr(c + 1), e.derived) &&
+                !e.derived.empty();
+            if (!fine)
+                return fail(err_invalid_hash);
+            e.iterations = static_cast<unsigned>(iterations);
+        }
+        auto found = positions.emplace(e.key, next->entries.size());
+        if (found.second)
+            next->entries.push_back(move(e));
+        else
+            next->entries[found.first->second] = move(e);   /* the later line wins */
+    }
+    next->build();
+    lock_guard<mutex> lock(reload_mutex_);
+    table_.publish(move(next));
+    return true;
+}
+
+bool credential_store::check(
+    string_view name,
+    string_view type,
+    string_view password,
+    bool &multiple_login) const
+{
+    return table_.read([&](const table &t) {
+        uint32_t index = 0;
+        string key(1, 'd');
+        const entry *e = t.find(key.append(name), index);
+        if (!e)
+            e = t.find(key.assign(1, 't').append(type), index);
+        if (!e)
+            return false;
+        multiple_login = e->multiple_login;
+        return e->open || verify(*e, index, t, password);
+    });
+}
+
+bool credential_store::verify(
+    const entry &e,
+    uint32_t index,
+    const table &t,
+    string_view password) const
+{
+    /* a keyed digest of the password, cheap to compare to the one
+     * remembered after the last successful derivation */
+    digest d;
+    cache_digest(e.salt, password, d.data());
+    auto &shard = t.cache[index % t.cache.size()];
+    {
+        lock_guard<mutex> lock(shard.mutex);
+        auto it = shard.verified.find(index);
+        if (it != shard.verified.end() &&
+            CRYPTO_memcmp(it->second.data(), d.data(), d.size()) == 0)
+            return true;
+    }
+    auto derived = derive(password, e.salt, e.iterations, e.derived.size());
+    if (CRYPTO_memcmp(derived.data(), e.derived.data(), derived.size()) != 0)
+        return false;
+    lock_guard<mutex> lock(shard.mutex);
+    shard.verified[index] = d;
+    return true;
+}
+
+size_t credential_store::size() const
+{
+    return table_.read([](const table &t) {
+        return t.entries.size();
+    });
+}
+
+string credential_store::hash_password(const string &password, unsigned iterations)
+{
+    string salt(16, '\0');
+    RAND_bytes(reinterpret_cast<unsigned char *>(&salt[0]), salt.size());
+    auto derived = derive(password, salt, iterations, 32);
+    return string(hash_scheme) + ":" + to_string(iterations) + ":" +
+        to_hex(salt) + ":" + to_hex(derived);
+}
+
+}}
@@ -0,0 +1,138 @@
+#ifndef CREDENTIAL_STORE_HPP_INCLUDED
+#define CREDENTIAL_STORE_HPP_INCLUDED
+
+#include <array>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <src/riot/server/rcu_cell.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief passwords of the devices, loaded from a file.
+ *
+ * the file has a line per device name or device type, the name entries
+ * being looked up first:
+ *
+ *     # comment
+ *     device <name> <hash> [multiple]
+ *     type <type> <hash> [multiple]
+ *
+ * <hash> is pbkdf2-sha256:<iterations>:<salt hex>:<key hex>, as given by
+ * hash_password(), or * for no password. multiple allows the device to log
+ * in more than once (enumerated names). a device matching no entry is
+ * rejected. of the lines giving the same name or type, the last one wins.
+ *
+ * the entries are kept in an immutable open addressing table, read without
+ * locking and replaced as a whole by reload(), so that the logins are never
+ * paused by a reload. a password verified once is remembered, as a keyed
+ * digest, so that a reconnecting device doesn't cost a key derivation again;
+ * the remembered digests go with the table on reload.
+ *
+ * all the member functions are thread safe.
+ */
+class credential_store {
+public:
+    credential_store() = default;
+    credential_store(const credential_store &) = delete;
+    credential_store &operator=(const credential_store &) = delete;
+
+    /**
+     * @brief loads the file and remembers its path for reload().
+     *
+     * @param error set to the reason, with the line number, on failure.
+     * @return bool false if the file can't be read or is malformed, the
+     * entries are unchanged then.
+     */
+    bool load(const std::string &path, std::string &error);
+
+    /**
+     * @brief loads the file given to load() again.
+     *
+     */
+    bool reload(std::string &error);
+
+    /**
+     * @brief loads the entries from a stream, see load().
+     *
+     */
+    bool load(std::istream &in, std::string &error);
+
+    /**
+     * @brief checks the password of a device.
+     *
+     * @param multiple_login set to true if the device may log in more than
+     * once.
+     * @return bool true if the device is allowed.
+     */
+    bool check(
+        std::string_view name,
+        std::string_view type,
+        std::string_view password,
+        bool &multiple_login) const;
+
+    /**
+     * @brief returns the number of the entries, i.e. of the distinct names
+     * and types.
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief derives the <hash> of a password for the file, with a random
+     * salt.
+     *
+     * @return std::string
+     */
+    static std::string hash_password(
+        const std::string &password,
+        unsigned iterations = 100000);
+private:
+    struct entry {
+        std::string key;            /* 'd' or 't', then the name or the type */
+        bool open;                  /* no password */
+        bool multiple_login;
+        unsigned iterations;
+        std::string salt;
+        std::string derived;
+    };
+
+    using digest = std::array<unsigned char, 32>;
+
+    struct table {
+        std::vector<entry> entries;     /* of distinct keys */
+        /* indices into entries + 1, 0 for empty, by the hash of the key */
+        std::vector<std::uint32_t> slots;
+        std::size_t mask { 0 };
+
+        /* digests of the verified passwords by entry, mutable in the
+         * snapshot, sharded by the index of the entry */
+        struct cache_shard {
+            std::mutex mutex;
+            std::unordered_map<std::uint32_t, digest> verified;
+        };
+        mutable std::array<cache_shard, 16> cache;
+
+        const entry *find(std::string_view key, std::uint32_t &index) const;
+        void build();
+    };
+
+    mutable std::mutex reload_mutex_;  /* serializes the writers */
+    std::string path_;
+    rcu_cell<table> table_;
+
+    bool verify(const entry &e, std::uint32_t index, const table &t, std::string_view password) const;
+};
+
+}}
+
+#endif // CREDENTIAL_STORE_HPP_INCLUDED
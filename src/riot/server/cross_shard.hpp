@@ -0,0 +1,57 @@
+#ifndef CROSS_SHARD_HPP_INCLUDED
+#define CROSS_SHARD_HPP_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <boost/asio.hpp>
+
+namespace riot { namespace server {
+
+using namespace boost::asio;
+
+/**
+ * @brief calls deliver(recipient) for each distinct recipient, batching the
+ * recipients by the io_service (shard) they run on.
+ *
+ * the recipients of the local io_service are delivered immediately. those of
+ * each other io_service are delivered by a single handler posted to it, so a
+ * trigger wakes another thread once, not once per recipient. with a single
+ * io_service, everything is local.
+ *
+ * @param local io_service of the calling thread.
+ * @param recipients pointers to the sessions, providing shard(). sorted and
+ * deduplicated in place.
+ * @param deliver copyable callable, called as deliver(const Ptr &).
+ */
+template <typename Ptr, typename F>
+void post_by_shard(io_service &local, std::vector<Ptr> &recipients, const F &deliver) {
+    std::sort(recipients.begin(), recipients.end(),
+        [](const Ptr &a, const Ptr &b) {
+            auto sa = &a->shard(), sb = &b->shard();
+            return sa != sb ? std::less<io_service *>()(sa, sb) : a < b;
+        });
+    recipients.erase(
+        std::unique(recipients.begin(), recipients.end()),
+        recipients.end());
+    for (auto it = recipients.begin(); it != recipients.end();) {
+        auto &shard = (*it)->shard();
+        auto end = std::find_if(it, recipients.end(), [&shard](const Ptr &p) {
+            return &p->shard() != &shard;
+        });
+        if (&shard == &local) {
+            for (; it != end; ++it)
+                deliver(*it);
+            continue;
+        }
+        shard.post([batch = std::vector<Ptr>(it, end), deliver] {
+            for (auto &recipient: batch)
+                deliver(recipient);
+        });
+        it = end;
+    }
+}
+
+}}
+
+#endif // CROSS_SHARD_HPP_INCLUDED
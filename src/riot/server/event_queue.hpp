@@ -0,0 +1,157 @@
+#ifndef EVENT_QUEUE_HPP_INCLUDED
+#define EVENT_QUEUE_HPP_INCLUDED
+
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include <src/riot/server/configuration.hpp>
+#include <src/riot/server/payload.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief queue of the events waiting to be written to a session, bounded in
+ * bytes and in messages.
+ *
+ * when an event doesn't fit, the overflow policy decides: the oldest events
+ * are dropped, the new event is dropped, the event replaces the queued one
+ * having the same key (coalesce, the oldest are dropped if it's still too
+ * much), or the queue reports the overflow so that the session is closed.
+ *
+ * not thread safe, it's owned by the strand of a session.
+ */
+class event_queue {
+public:
+    enum push_result {
+        queued = 0,     /* appended, possibly after dropping older events */
+        replaced,       /* coalesced with a queued event */
+        dropped,        /* the new event is dropped */
+        overflow        /* doesn't fit and the policy is disconnect */
+    };
+
+    event_queue(
+        std::size_t max_bytes,
+        std::size_t max_messages,
+        overflow_policy policy) :
+        max_bytes_(max_bytes),
+        max_messages_(max_messages ? max_messages : 1),
+        policy_(policy)
+    {}
+
+    /**
+     * @brief adds an event.
+     *
+     * @param data event to write.
+     * @param key identifies the events replacing each other when the policy
+     * is coalesce, e.g. a hash of the eid and the triggering device.
+     * @param n_dropped incremented by the number of the events dropped.
+     * @return push_result
+     */
+    push_result push(payload::ptr data, std::uint64_t key, std::size_t &n_dropped) {
+        if (policy_ == overflow_policy::coalesce) {
+            auto it = by_key_.find(key);
+            if (it != by_key_.end()) {
+                auto &e = events_[it->second - popped_];
+                bytes_ = bytes_ - e.data->size() + data->size();
+                e.data = std::move(data);
+                ++n_dropped;    /* the replaced one */
+                return replaced;
+            }
+        }
+        if (!fits(data->size())) {
+            switch (policy_) {
+            case overflow_policy::drop_newest:
+                ++n_dropped;
+                return dropped;
+            case overflow_policy::disconnect:
+                return overflow;
+            case overflow_policy::drop_oldest:
+            case overflow_policy::coalesce:
+                while (!events_.empty() && !fits(data->size())) {
+                    pop();
+                    ++n_dropped;
+                }
+                break;
+            }
+        }
+        if (policy_ == overflow_policy::coalesce)
+            by_key_[key] = popped_ + events_.size();
+        bytes_ += data->size();
+        events_.push_back(entry { std::move(data), key });
+        return queued;
+    }
+
+    /**
+     * @brief removes and returns the oldest event.
+     *
+     * @return payload::ptr
+     */
+    payload::ptr pop() {
+        auto &e = events_.front();
+        if (policy_ == overflow_policy::coalesce) {
+            auto it = by_key_.find(e.key);
+            if (it != by_key_.end() && it->second == popped_)
+                by_key_.erase(it);
+        }
+        auto data = std::move(e.data);
+        bytes_ -= data->size();
+        events_.pop_front();
+        ++popped_;
+        return data;
+    }
+
+    const payload::ptr &front() const
+    { return events_.front().data; }
+
+    bool empty() const
+    { return events_.empty(); }
+
+    std::size_t size() const
+    { return events_.size(); }
+
+    std::size_t bytes() const
+    { return bytes_; }
+
+    /**
+     * @brief returns true if the queue is filled above the given fraction of
+     * its limits.
+     *
+     */
+    bool above(double fraction) const {
+        return bytes_ > max_bytes_ * fraction ||
+            events_.size() > max_messages_ * fraction;
+    }
+
+    void clear() {
+        events_.clear();
+        by_key_.clear();
+        bytes_ = 0;
+    }
+private:
+    struct entry {
+        payload::ptr data;
+        std::uint64_t key;
+    };
+
+    std::size_t max_bytes_;
+    std::size_t max_messages_;
+    overflow_policy policy_;
+
+    std::deque<entry> events_;
+    std::size_t bytes_ { 0 };
+    /* sequence numbers of the queued events by key, for coalescing */
+    std::uint64_t popped_ { 0 };
+    std::unordered_map<std::uint64_t, std::uint64_t> by_key_;
+
+    bool fits(std::size_t size) const {
+        return events_.size() < max_messages_ &&
+            (events_.empty() || bytes_ + size <= max_bytes_);
+    }
+};
+
+}}
+
+#endif // EVENT_QUEUE_HPP_INCLUDED
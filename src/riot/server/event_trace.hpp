@@ -0,0 +1,27 @@
+#ifndef EVENT_TRACE_HPP_INCLUDED
+#define EVENT_TRACE_HPP_INCLUDED
+
+#include <chrono>
+#include <memory>
+
+namespace riot { namespace server {
+
+/**
+ * @brief timestamps of a sampled event, taken by the triggering session and
+ * carried to the recipients, which complete the trace when they enqueue the
+ * event and when it's written. see server_configuration::trace_sample_period.
+ *
+ */
+struct event_trace {
+    using clock_type = std::chrono::steady_clock;
+
+    clock_type::time_point read;    /* the trig line was read */
+    clock_type::time_point routed;  /* its recipients were found */
+};
+
+/* null for the events not sampled */
+using event_trace_ptr = std::shared_ptr<const event_trace>;
+
+}}
+
+#endif // EVENT_TRACE_HPP_INCLUDED
@@ -1,78 +1,88 @@
-#include <sstream>
-#include <regex>
+#include <charconv>
+#include <cmath>
+#include <algorithm>
 
 #include <src/riot/server/header_parser.hpp>
+#include <src/riot/server/tokenizer.hpp>
 
 using namespace std;
 
 namespace riot { namespace server {
 
-bool header_parser::is_valid_version(const string& str)
+namespace {
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+}
+
+header_parser::header_parser(std::pmr::memory_resource *resource) :
+    version(resource),
+    name(resource),
+    type(resource),
+    password(resource),
+    error_msg_(resource)
 {
-    static regex r(R"(\d+\.\d+)");
-    return regex_match(str, r);
 }
 
-bool header_parser::is_valid_id(const string& str)
+bool header_parser::is_valid_version(string_view str)
 {
-    static regex r(R"([a-zA-Z0-9_,-]+)");
-    return regex_match(str, r);
+    /* \d+\.\d+ */
+    auto dot = str.find('.');
+    return dot != 0 && dot != string_view::npos && dot + 1 < str.size() &&
+        all_of(str.begin(), str.begin() + dot, is_digit) &&
+        all_of(str.begin() + dot + 1, str.end(), is_digit);
 }
 
-bool header_parser::string_to_timeout(const string& str, bool& has_timeout, uint64_t& timeout)
+bool header_parser::is_valid_id(string_view str)
 {
-    istringstream iss(str);
-    long double dummy1;
-    if (iss >> dummy1) {
-        has_timeout = true;
-        string dummy2;
-        if (iss >> dummy2) {
-            if (dummy2 == "s") {
-                dummy1 *= 1e3;
-            }
-            else if (dummy2 == "ms") {
-                dummy1 *= 1;
-            }
-            else if (dummy2 == "min") {
-                dummy1 *= 60e3;
-            }
-            else if (dummy2 == "h") {
-                dummy1 *= 3600e3;
-            }
-            else if (dummy2 == "day") {
-                dummy1 *= 24 * 3600e3;
-            }
-            else if (dummy2 == "wk") {
-                dummy1 *= 7 * 24 * 3600e3;
-            }
-            else {
-                return false;
-            }
-            /* at this point we shouldn't have anything left in the stream */
-            if (iss >> dummy2) {
-                return false;
-            }
-            timeout = dummy1;
-            return true;
-        }
-        else {
-            /* default is millis */
-            timeout = dummy1;
-            return true;
-        }
+    /* [a-zA-Z0-9_,-]+ */
+    return !str.empty() && all_of(str.begin(), str.end(), [](char c) {
+        return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            c == '_' || c == ',' || c == '-';
+    });
+}
+
+bool header_parser::string_to_timeout(string_view str, bool& has_timeout, uint64_t& timeout)
+{
+    if (str == "inf") {
+        has_timeout = false;
+        return true;
+    }
+    double value;
+    auto result = from_chars(str.data(), str.data() + str.size(), value);
+    if (result.ec != errc() || !isfinite(value) || value < 0) {
+        return false;
+    }
+    string_view unit(result.ptr, str.data() + str.size() - result.ptr);
+    if (unit.empty() || unit == "ms") {
+        /* default is millis */
+    }
+    else if (unit == "s") {
+        value *= 1e3;
+    }
+    else if (unit == "min") {
+        value *= 60e3;
+    }
+    else if (unit == "h") {
+        value *= 3600e3;
+    }
+    else if (unit == "day") {
+        value *= 24 * 3600e3;
+    }
+    else if (unit == "wk") {
+        value *= 7 * 24 * 3600e3;
     }
     else {
-        if (str == "inf") {
-            has_timeout = false;
-            return true;
-        }
-        else {
-            return false;
-        }
+        return false;
     }
+    has_timeout = true;
+    timeout = value;
+    return true;
 }
 
-bool header_parser::feed_line(const std::string& line)
+bool header_parser::feed_line(string_view line)
 {
     // BEGIN error messages
     static const char *err_riotp_appear_first   = "RIOTp must appear first";
@@ -84,16 +94,21 @@ bool header_parser::feed_line(const std::string& line)
     static const char *err_invalid_command      = "not a valid command";
     // END
     ++nline_;
-    istringstream iss(line);
-    string dummy;
-    if (iss >> dummy) {
+    string_view rest = line;
+    string_view dummy;
+    /* the tokens are views into the line */
+    auto next = [&rest, &dummy] {
+        dummy = next_token(rest);
+        return !dummy.empty();
+    };
+    if (next()) {
         if (dummy == "END") {
             return false; // we are done!
         }
         else if (is_fine()) {
             if (dummy == "RIOTp") {
                 if (nline_ == 1) {
-                    if (iss >> dummy) {
+                    if (next()) {
                         if (is_valid_version(dummy)) {
                             version = dummy;
                         }
@@ -111,10 +126,10 @@ bool header_parser::feed_line(const std::string& line)
             }
             /* end RIOTp */
             else if (dummy == "name:") {
-                if (iss >> dummy) {
+                if (next()) {
                     if (is_valid_id(dummy)) {
                         name = dummy;
-                        if (iss >> dummy) {
+                        if (next()) {
                             if (dummy == "enumerated") {
                                 name_flag = enumerated;
                             }
@@ -139,7 +154,7 @@ bool header_parser::feed_line(const std::string& line)
             }
             /* end name: */
             else if (dummy == "type:") {
-                if (iss >> dummy) {
+                if (next()) {
                     if (is_valid_id(dummy)) {
                         type = dummy;
                     }
@@ -153,7 +168,7 @@ bool header_parser::feed_line(const std::string& line)
             }
             /* end type: */
             else if (dummy == "password:") {
-                if (iss >> dummy) {
+                if (next()) {
                     password = dummy;
                 }
                 else {
@@ -162,7 +177,7 @@ bool header_parser::feed_line(const std::string& line)
             }
             /* end password: */
             else if (dummy == "name-policy:") {
-                if (iss >> dummy) {
+                if (next()) {
                     if (dummy == "weak") {
                         name_policy = weak;
                     }
@@ -179,7 +194,7 @@ bool header_parser::feed_line(const std::string& line)
             }
             /* end name-policy: */
             else if (dummy == "timeout:") {
-                if (iss >> dummy) {
+                if (next()) {
                     if (string_to_timeout(dummy, has_timeout, timeout)) {
                     }
                     else {
@@ -196,7 +211,7 @@ bool header_parser::feed_line(const std::string& line)
             }
             
             /* ensure no more arguments are left */
-            if (is_fine() && iss >> dummy) {
+            if (is_fine() && next()) {
                 // check is_fine() to not override previous message
                 set_error_msg(err_too_many_args);
             }
@@ -221,7 +236,7 @@ bool header_parser::is_fine() const
 
 std::string header_parser::error_msg() const
 {
-    return error_msg_;
+    return std::string(error_msg_);
 }
 
 }}
@@ -2,23 +2,32 @@
 #define _HEADER_PARSER_INCLUDED
 
 #include <string>
-#include <map>
-#include <sstream>
+#include <string_view>
+#include <memory_resource>
+#include <charconv>
 #include <cstdint>
 
 namespace riot { namespace server {
 
 class header_parser {
 public:
-    std::string version;
-    std::string name;
+    /**
+     * @brief constructor.
+     * 
+     * @param resource memory of the strings, must outlive the parser.
+     */
+    explicit header_parser(
+        std::pmr::memory_resource *resource = std::pmr::new_delete_resource());
+    
+    std::pmr::string version;
+    std::pmr::string name;
     enum {
         normal = 0,
         uniquify = 1,
         enumerated = 2
     } name_flag { normal };
-    std::string type;
-    std::string password;
+    std::pmr::string type;
+    std::pmr::string password;
     enum {
         strong = 0,
         weak = 1
@@ -33,25 +42,26 @@ public:
      * @param line line to parse
      * @return bool
      */
-    bool feed_line(const std::string &line);
+    bool feed_line(std::string_view line);
     
     bool is_fine() const;
     std::string error_msg() const;
     
-    static bool is_valid_version(const std::string &str);
-    static bool is_valid_id(const std::string &str);
-    static bool string_to_timeout(const std::string &str, bool &has_timeout, std::uint64_t &timeout);
+    static bool is_valid_version(std::string_view str);
+    static bool is_valid_id(std::string_view str);
+    static bool string_to_timeout(std::string_view str, bool &has_timeout, std::uint64_t &timeout);
 private:
     int nline_ {0};
-    std::string error_msg_;
+    std::pmr::string error_msg_;
     
+    /* the pieces are strings */
     template <typename ...T>
     void set_error_msg(T && ...t) {
-        std::ostringstream oss;
-        oss << "syntax error (line = " << nline_ << "): ";
-        using helper_t = int [];
-        (void) helper_t { 0, ( oss << t, 0 ) ... };
-        error_msg_ = oss.str();
+        char line[16];
+        error_msg_.assign("syntax error (line = ");
+        error_msg_.append(line, std::to_chars(line, line + sizeof line, nline_).ptr);
+        error_msg_.append("): ");
+        (error_msg_.append(std::string_view(t)), ...);
     }
 };
 
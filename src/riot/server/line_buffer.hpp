@@ -0,0 +1,151 @@
+#ifndef LINE_BUFFER_HPP_INCLUDED
+#define LINE_BUFFER_HPP_INCLUDED
+
+#include <memory>
+#include <algorithm>
+#include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <boost/asio/buffer.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief per-connection read buffer splitting the received bytes into
+ * lines without copying them.
+ *
+ * bytes are read in chunks into the free space at the end of the buffer,
+ * complete lines are handed out as views into the buffer. the consumed
+ * bytes are reclaimed by moving the incomplete tail of the data to the
+ * front when the buffer runs out of space, the buffer grows only if a
+ * single line doesn't fit into it.
+ *
+ * the views returned by next_line() are valid until the next call to
+ * prepare(). a line longer than the maximum capacity is dropped with
+ * discard_line().
+ */
+class line_buffer {
+public:
+    /**
+     * @brief constructor.
+     *
+     * @param capacity initial capacity, the size of the chunks read.
+     * @param max_capacity upper limit on the capacity, i.e. on the length
+     * of a line.
+     */
+    explicit line_buffer(
+        std::size_t capacity = 4096,
+        std::size_t max_capacity = 65536) :
+        data_(new char[capacity]),
+        capacity_(capacity),
+        max_capacity_(max_capacity < capacity ? capacity : max_capacity)
+    {}
+
+    /**
+     * @brief extracts the next complete line, without the trailing '\n'.
+     *
+     * @param line set to the line if there is one.
+     * @return bool false if there is no complete line in the buffer.
+     */
+    bool next_line(std::string_view &line) {
+        auto newline = static_cast<const char *>(
+            std::memchr(data_.get() + scan_, '\n', end_ - scan_));
+        if (!newline) {
+            scan_ = end_;
+            if (discarding_)
+                begin_ = end_;
+            return false;
+        }
+        std::size_t pos = newline - data_.get();
+        if (discarding_) {
+            /* the end of the discarded line */
+            discarding_ = false;
+            begin_ = scan_ = pos + 1;
+            return next_line(line);
+        }
+        line = std::string_view(data_.get() + begin_, pos - begin_);
+        begin_ = scan_ = pos + 1;
+        return true;
+    }
+
+    /**
+     * @brief returns the free space at the end of the buffer, to read into.
+     *
+     * it might move the unconsumed bytes, invalidating the views returned
+     * previously.
+     *
+     * @return boost::asio::mutable_buffer empty if the buffer is full of an
+     * incomplete line of the maximum length.
+     */
+    boost::asio::mutable_buffer prepare() {
+        if (begin_ == end_) {
+            begin_ = end_ = scan_ = 0;
+        }
+        else if (end_ == capacity_) {
+            if (begin_ > 0) {
+                std::memmove(data_.get(), data_.get() + begin_, end_ - begin_);
+                end_ -= begin_;
+                scan_ -= begin_;
+                begin_ = 0;
+            }
+            else if (capacity_ < max_capacity_) {
+                std::size_t capacity = std::min(capacity_ * 2, max_capacity_);
+                std::unique_ptr<char[]> data(new char[capacity]);
+                std::memcpy(data.get(), data_.get(), end_);
+                data_ = std::move(data);
+                capacity_ = capacity;
+            }
+        }
+        return boost::asio::buffer(data_.get() + end_, capacity_ - end_);
+    }
+
+    /**
+     * @brief appends n bytes read into the buffer returned by prepare().
+     *
+     * @param n number of bytes.
+     */
+    void commit(std::size_t n)
+    { end_ += n; }
+
+    /**
+     * @brief returns the unconsumed bytes.
+     *
+     * @return std::string_view
+     */
+    std::string_view data() const
+    { return std::string_view(data_.get() + begin_, end_ - begin_); }
+
+    /**
+     * @brief drops the incomplete line filling the buffer, and the bytes
+     * received later up to its '\n'.
+     *
+     */
+    void discard_line() {
+        begin_ = scan_ = end_;
+        discarding_ = true;
+    }
+
+    /**
+     * @brief discards n unconsumed bytes.
+     *
+     * @param n number of bytes.
+     */
+    void consume(std::size_t n) {
+        begin_ += n;
+        if (scan_ < begin_)
+            scan_ = begin_;
+    }
+
+private:
+    std::unique_ptr<char[]> data_;
+    std::size_t capacity_;
+    std::size_t max_capacity_;
+    std::size_t begin_ { 0 };   /* first unconsumed byte */
+    std::size_t scan_ { 0 };    /* no '\n' in [begin_, scan_) */
+    std::size_t end_ { 0 };     /* end of the received bytes */
+    bool discarding_ { false }; /* up to the next '\n' */
+};
+
+}}
+
+#endif // LINE_BUFFER_HPP_INCLUDED
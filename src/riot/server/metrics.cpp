@@ -0,0 +1,101 @@
+#include <locale>
+#include <sstream>
+
+#include <src/riot/server/metrics.hpp>
+
+using namespace std;
+
+namespace riot { namespace server {
+
+namespace {
+
+struct description {
+    const char *name;
+    const char *help;
+};
+
+const description counters[] = {
+    { "riot_accepts_total",             "Accepted connections." },
+    { "riot_handshakes_full_total",     "Full tls handshakes." },
+    { "riot_handshakes_resumed_total",  "Resumed tls handshakes." },
+    { "riot_handshakes_failed_total",   "Failed tls handshakes." },
+    { "riot_logins_total",              "Successful logins." },
+    { "riot_login_failures_total",      "Rejected logins." },
+    { "riot_triggers_total",            "Triggered xeids." },
+    { "riot_events_routed_total",       "Deliveries of the triggered events." },
+    { "riot_bytes_in_total",            "Bytes read from the devices." },
+    { "riot_bytes_out_total",           "Bytes written to the devices." },
+    { "riot_writes_total",              "Write operations." },
+    { "riot_write_buffers_total",       "Buffers written by the write operations." },
+    { "riot_events_dropped_total",      "Events dropped by the overflow policies." },
+    { "riot_overflows_total",           "Sessions closed because their queue was full." },
+};
+
+static_assert(sizeof(counters) / sizeof(counters[0]) == metrics_registry::counter_count,
+    "a description per counter");
+
+/* scale converts the recorded values to the unit of the name */
+struct histogram_description {
+    const char *name;
+    const char *help;
+    double scale;
+};
+
+const histogram_description histograms[] = {
+    { "riot_handshake_seconds",     "Duration of the tls handshakes.", 1e-9 },
+    { "riot_login_seconds",         "Duration of the logins, from the end of the header.", 1e-9 },
+    { "riot_fanout",                "Recipients of a triggered event.", 1 },
+    { "riot_write_queue_depth",     "Buffers queued for a session when a write starts.", 1 },
+    { "riot_trace_route_seconds",   "Sampled events, from the read of the trig line to the routing.", 1e-9 },
+    { "riot_trace_dispatch_seconds", "Sampled events, from the routing to the queue of a recipient.", 1e-9 },
+    { "riot_trace_write_seconds",   "Sampled events, from the queue of a recipient to the completion of the write.", 1e-9 },
+    { "riot_trace_total_seconds",   "Sampled events, from the read of the trig line to the completion of the write.", 1e-9 },
+};
+
+static_assert(sizeof(histograms) / sizeof(histograms[0]) == metrics_registry::histogram_count,
+    "a description per histogram");
+
+/* by command_parser::type_t, from empty */
+const char *command_names[] = {
+    "empty", "invalid", "trig", "sub", "unsub", "negsub", "unnegsub",
+    "pause", "continue", "p2p-accept", "p2p-stop-accept", "p2p-disconnect",
+    "p2p-send"
+};
+
+static_assert(sizeof(command_names) / sizeof(command_names[0]) == metrics_registry::command_count,
+    "a name per command type");
+
+const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+}
+
+string metrics_registry::prometheus() const
+{
+    auto t = collect();
+    ostringstream oss;
+    oss.imbue(locale::classic());  /* no digit grouping */
+    for (size_t i = 0; i < counter_count; ++i) {
+        oss << "# HELP " << counters[i].name << ' ' << counters[i].help << '\n'
+            << "# TYPE " << counters[i].name << " counter\n"
+            << counters[i].name << ' ' << t.counters[i] << '\n';
+    }
+    oss << "# HELP riot_commands_total Parsed command lines, by type.\n"
+        << "# TYPE riot_commands_total counter\n";
+    for (size_t i = 0; i < command_count; ++i)
+        oss << "riot_commands_total{type=\"" << command_names[i] << "\"} "
+            << t.commands[i] << '\n';
+    for (size_t h = 0; h < histogram_count; ++h) {
+        auto &d = histograms[h];
+        auto &values = t.histograms[h];
+        oss << "# HELP " << d.name << ' ' << d.help << '\n'
+            << "# TYPE " << d.name << " summary\n";
+        for (auto q: quantiles)
+            oss << d.name << "{quantile=\"" << q << "\"} "
+                << values.quantile(q) * d.scale << '\n';
+        oss << d.name << "_sum " << values.sum() * d.scale << '\n'
+            << d.name << "_count " << values.count() << '\n';
+    }
+    return oss.str();
+}
+
+}}
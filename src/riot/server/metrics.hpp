@@ -0,0 +1,255 @@
+#ifndef METRICS_HPP_INCLUDED
+#define METRICS_HPP_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include <src/riot/server/command_parser.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief distribution of non-negative values, with log-linear buckets as
+ * in hdr histograms: the values below 32 have a bucket each, each power of
+ * two beyond is divided into 16 buckets, so a quantile is given within
+ * 1/16 of its value.
+ *
+ */
+class log_histogram {
+public:
+    static constexpr std::size_t sub_buckets = 16;
+    static constexpr std::size_t bucket_count = 2 * sub_buckets + (63 - 4) * sub_buckets;
+
+    static std::size_t bucket_of(std::uint64_t value) {
+        if (value < 2 * sub_buckets)
+            return value;
+        unsigned e = 63 - __builtin_clzll(value);  /* >= 5 */
+        auto m = value >> (e - 4);                  /* in [16, 32) */
+        return 2 * sub_buckets + (e - 5) * sub_buckets + (m - sub_buckets);
+    }
+
+    /* the largest value of the bucket */
+    static std::uint64_t upper_bound(std::size_t bucket) {
+        if (bucket < 2 * sub_buckets)
+            return bucket;
+        unsigned e = (bucket - 2 * sub_buckets) / sub_buckets + 5;
+        std::uint64_t m = (bucket - 2 * sub_buckets) % sub_buckets + sub_buckets;
+        return ((m + 1) << (e - 4)) - 1;
+    }
+
+    void add(std::size_t bucket, std::uint64_t n)
+    { buckets_[bucket] += n; count_ += n; }
+
+    void add_sum(std::uint64_t sum)
+    { sum_ += sum; }
+
+    void merge(const log_histogram &other) {
+        for (std::size_t i = 0; i < bucket_count; ++i)
+            buckets_[i] += other.buckets_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+    }
+
+    std::uint64_t count() const
+    { return count_; }
+
+    std::uint64_t sum() const
+    { return sum_; }
+
+    /**
+     * @brief returns the value below which the given fraction of the values
+     * are, 0 if empty.
+     *
+     */
+    std::uint64_t quantile(double q) const {
+        if (count_ == 0)
+            return 0;
+        auto rank = static_cast<std::uint64_t>(q * (count_ - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i)
+            if ((seen += buckets_[i]) >= rank)
+                return upper_bound(i);
+        return upper_bound(bucket_count - 1);
+    }
+private:
+    std::array<std::uint64_t, bucket_count> buckets_ {};
+    std::uint64_t count_ { 0 };
+    std::uint64_t sum_ { 0 };
+};
+
+/**
+ * @brief counters and histograms of the servers sharing it.
+ *
+ * each thread updates a slot of its own, on its own cache lines, with plain
+ * loads and stores (no locked instructions); the slots are summed when the
+ * metrics are collected, which may be done from any thread. a thread finds
+ * its slot through a thread local pointer, the registry is only locked the
+ * first time.
+ */
+class metrics_registry {
+public:
+    enum counter_t {
+        accepts = 0,
+        handshakes_full,
+        handshakes_resumed,
+        handshakes_failed,
+        logins,
+        login_failures,
+        triggers,               /* xeids triggered */
+        events_routed,          /* deliveries of the triggered events */
+        bytes_in,
+        bytes_out,
+        writes,                 /* write operations */
+        write_buffers,          /* buffers written by them */
+        events_dropped,         /* by the overflow policies */
+        overflows,              /* sessions closed by the disconnect policy */
+        counter_count
+    };
+
+    enum histogram_t {
+        handshake_ns = 0,       /* tls, from the accept */
+        login_ns,               /* from the end of the header to the reply */
+        fanout,                 /* recipients of a triggered event */
+        write_queue_depth,      /* buffers queued when a write starts */
+        trace_route_ns,         /* sampled events, see event_trace: read to routed, */
+        trace_dispatch_ns,      /* routed to queued by a recipient, */
+        trace_write_ns,         /* queued to written, */
+        trace_total_ns,         /* and read to written */
+        histogram_count
+    };
+
+    /* command_parser::type_t, from empty */
+    static constexpr std::size_t command_count = command_parser::p2p_send + 3;
+
+    metrics_registry() :
+        id_(next_id().fetch_add(1) + 1)
+    {}
+
+    metrics_registry(const metrics_registry &) = delete;
+    metrics_registry &operator=(const metrics_registry &) = delete;
+
+    void add(counter_t c, std::uint64_t n = 1)
+    { bump(local().counters[c], n); }
+
+    void add_command(command_parser::type_t type)
+    { bump(local().commands[type - command_parser::empty], 1); }
+
+    void record(histogram_t h, std::uint64_t value) {
+        auto &cells = local().histograms[h];
+        bump(cells.buckets[log_histogram::bucket_of(value)], 1);
+        bump(cells.sum, value);
+    }
+
+    /**
+     * @brief the sums of the slots of all the threads.
+     *
+     */
+    struct totals {
+        std::array<std::uint64_t, counter_count> counters {};
+        std::array<std::uint64_t, command_count> commands {};
+        std::array<log_histogram, histogram_count> histograms;
+    };
+
+    /**
+     * @brief sums the slots. the updates made meanwhile might or might not
+     * be seen.
+     *
+     * @return totals
+     */
+    totals collect() const {
+        totals t;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &p: slots_) {
+            const auto &s = *p.second;
+            for (std::size_t i = 0; i < counter_count; ++i)
+                t.counters[i] += s.counters[i].load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < command_count; ++i)
+                t.commands[i] += s.commands[i].load(std::memory_order_relaxed);
+            for (std::size_t h = 0; h < histogram_count; ++h) {
+                for (std::size_t i = 0; i < log_histogram::bucket_count; ++i)
+                    if (auto n = s.histograms[h].buckets[i].load(std::memory_order_relaxed))
+                        t.histograms[h].add(i, n);
+                t.histograms[h].add_sum(s.histograms[h].sum.load(std::memory_order_relaxed));
+            }
+        }
+        return t;
+    }
+
+    /**
+     * @brief returns a single counter summed over the threads.
+     *
+     * @return std::uint64_t
+     */
+    std::uint64_t total(counter_t c) const {
+        std::uint64_t n = 0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &p: slots_)
+            n += p.second->counters[c].load(std::memory_order_relaxed);
+        return n;
+    }
+
+    /**
+     * @brief formats the collected metrics in the prometheus text format,
+     * the histograms as summaries.
+     *
+     * @return std::string
+     */
+    std::string prometheus() const;
+private:
+    using cell = std::atomic<std::uint64_t>;
+
+    struct histogram_cells {
+        std::array<cell, log_histogram::bucket_count> buckets {};
+        cell sum { 0 };
+    };
+
+    struct alignas(64) slot {
+        std::array<cell, counter_count> counters {};
+        std::array<cell, command_count> commands {};
+        std::array<histogram_cells, histogram_count> histograms;
+    };
+
+    struct slot_cache {
+        std::uint64_t id { 0 };
+        slot *s { nullptr };
+    };
+
+    /* distinguishes the registries in the thread local caches, an address
+     * might be reused */
+    const std::uint64_t id_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<slot>> slots_;
+
+    static std::atomic<std::uint64_t> &next_id() {
+        static std::atomic<std::uint64_t> id { 0 };
+        return id;
+    }
+
+    /* only the owner thread writes to the cell */
+    static void bump(cell &c, std::uint64_t n)
+    { c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    slot &local() {
+        thread_local slot_cache cache;
+        if (cache.id != id_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &s = slots_[std::this_thread::get_id()];
+            if (!s)
+                s = std::make_unique<slot>();
+            cache = slot_cache { id_, s.get() };
+        }
+        return *cache.s;
+    }
+};
+
+}}
+
+#endif // METRICS_HPP_INCLUDED
@@ -0,0 +1,94 @@
+#ifndef P2P_DIRECTORY_HPP_INCLUDED
+#define P2P_DIRECTORY_HPP_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+namespace riot { namespace server {
+
+/**
+ * @brief concurrent directory of the sessions accepting p2p transfers, keyed
+ * by their p2pID.
+ *
+ * the p2pIDs are drawn from a 64-bit counter and never reused, so a stale
+ * p2pID held by a device designates no session rather than a later one
+ * (unlike the name symbols, which are reused once freed). the ids are
+ * distributed over shards, each locked by its own mutex; lookups are only
+ * done when a link is made, the links themselves hold the sessions.
+ *
+ * @param Session session type, the directory holds weak pointers to it.
+ */
+template <typename Session>
+class p2p_directory {
+public:
+    using ptr = std::shared_ptr<Session>;
+    using wptr = std::weak_ptr<Session>;
+
+    static constexpr std::size_t shard_count = 16;
+
+    /**
+     * @brief p2pID of no session, never returned by insert().
+     *
+     */
+    static constexpr std::uint64_t no_id = 0;
+
+    /**
+     * @brief registers a session under a new p2pID.
+     *
+     * @return std::uint64_t the p2pID, to be passed to erase() by the
+     * session before it's gone.
+     */
+    std::uint64_t insert(const ptr &session) {
+        auto id = next_.fetch_add(1, std::memory_order_relaxed);
+        auto &s = shard_of(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.sessions.emplace(id, session);
+        return id;
+    }
+
+    /**
+     * @brief removes the session registered under the p2pID.
+     *
+     */
+    void erase(std::uint64_t id) {
+        auto &s = shard_of(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.sessions.erase(id);
+    }
+
+    /**
+     * @brief returns the session registered under the p2pID, null if there
+     * is none or it's gone.
+     *
+     * @return ptr
+     */
+    ptr find(std::uint64_t id) const {
+        auto &s = shard_of(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.sessions.find(id);
+        return it == s.sessions.end() ? nullptr : it->second.lock();
+    }
+
+private:
+    struct shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::uint64_t, wptr> sessions;
+    };
+
+    std::atomic<std::uint64_t> next_ { no_id + 1 };
+    shard shards_[shard_count];
+
+    const shard &shard_of(std::uint64_t id) const
+    { return shards_[id % shard_count]; }
+
+    shard &shard_of(std::uint64_t id)
+    { return shards_[id % shard_count]; }
+};
+
+}}
+
+#endif // P2P_DIRECTORY_HPP_INCLUDED
@@ -0,0 +1,222 @@
+#ifndef PAYLOAD_HPP_INCLUDED
+#define PAYLOAD_HPP_INCLUDED
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace riot { namespace server {
+
+/**
+ * @brief immutable, reference counted block of bytes to be written to the
+ * sessions.
+ *
+ * the counter and the bytes are allocated together, and the counter is
+ * intrusive, so a payload costs a single allocation and sharing it with
+ * many sessions costs an atomic increment per session, never a copy.
+ *
+ * payloads are created by the make/copy/format factories and are only
+ * accessed through payload::ptr.
+ */
+class payload {
+public:
+    /**
+     * @brief intrusive shared pointer to a payload.
+     *
+     */
+    class ptr {
+    public:
+        ptr() noexcept
+        {}
+
+        ptr(const ptr &other) noexcept :
+            p_(other.p_) {
+            if (p_)
+                p_->refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ptr(ptr &&other) noexcept :
+            p_(other.p_) {
+            other.p_ = nullptr;
+        }
+
+        ptr &operator=(ptr other) noexcept {
+            std::swap(p_, other.p_);
+            return *this;
+        }
+
+        ~ptr() {
+            if (p_ && p_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                p_->~payload();
+                ::operator delete(p_);
+            }
+        }
+
+        const payload &operator*() const noexcept
+        { return *p_; }
+
+        const payload *operator->() const noexcept
+        { return p_; }
+
+        const payload *get() const noexcept
+        { return p_; }
+
+        explicit operator bool() const noexcept
+        { return p_ != nullptr; }
+
+        /**
+         * @brief returns the number of the pointers sharing the payload.
+         *
+         * @return std::uint32_t
+         */
+        std::uint32_t use_count() const noexcept
+        { return p_ ? p_->refs_.load(std::memory_order_relaxed) : 0; }
+    private:
+        friend class payload;
+
+        explicit ptr(payload *p) noexcept :
+            p_(p)
+        {}
+
+        payload *p_ { nullptr };
+    };
+
+    const char *data() const noexcept
+    { return reinterpret_cast<const char *>(this + 1); }
+
+    std::size_t size() const noexcept
+    { return size_; }
+
+    const char *begin() const noexcept
+    { return data(); }
+
+    const char *end() const noexcept
+    { return data() + size_; }
+
+    std::string_view view() const noexcept
+    { return std::string_view(data(), size_); }
+
+    /**
+     * @brief allocates a payload of the given size and lets fill(char *)
+     * initialize its bytes, before it's shared.
+     *
+     */
+    template <typename F>
+    static ptr make(std::size_t size, F &&fill) {
+        void *memory = ::operator new(sizeof(payload) + size);
+        auto p = new (memory) payload(size);
+        ptr result(p);
+        fill(reinterpret_cast<char *>(p + 1));
+        return result;
+    }
+
+    /**
+     * @brief allocates a payload of the given size whose bytes are filled
+     * later, e.g. by a read operation, through the returned pointer. the
+     * bytes must be filled before the payload is shared.
+     *
+     */
+    static ptr allocate(std::size_t size, char *&bytes) {
+        return make(size, [&bytes](char *out) {
+            bytes = out;
+        });
+    }
+
+    /**
+     * @brief creates a payload holding a copy of the given bytes.
+     *
+     */
+    static ptr copy(const char *data, std::size_t size) {
+        return make(size, [data, size](char *out) {
+            std::memcpy(out, data, size);
+        });
+    }
+
+    /**
+     * @brief formats the arguments, which are strings, characters or
+     * integers, directly into a payload.
+     *
+     */
+    template <typename ...T>
+    static ptr format(const T & ...t) {
+        const piece pieces[] = { piece(t)... };
+        std::size_t size = 0;
+        for (const auto &p: pieces)
+            size += p.size();
+        return make(size, [&pieces](char *out) {
+            for (const auto &p: pieces) {
+                std::memcpy(out, p.data(), p.size());
+                out += p.size();
+            }
+        });
+    }
+
+private:
+    std::atomic<std::uint32_t> refs_ { 1 };
+    std::size_t size_;
+
+    explicit payload(std::size_t size) :
+        size_(size)
+    {}
+
+    payload(const payload &) = delete;
+    payload &operator=(const payload &) = delete;
+
+    /* argument of format(), integers are converted in place */
+    class piece {
+    public:
+        piece(std::string_view s) :
+            data_(s.data()),
+            size_(s.size())
+        {}
+
+        piece(const std::string &s) :
+            piece(std::string_view(s))
+        {}
+
+        piece(const char *s) :
+            piece(std::string_view(s))
+        {}
+
+        piece(char c) :
+            local_(true),
+            size_(1) {
+            buf_[0] = c;
+        }
+
+        template <
+            typename T,
+            typename = std::enable_if_t<
+                std::is_integral<T>::value &&
+                !std::is_same<T, bool>::value>>
+        piece(T value) :
+            local_(true) {
+            auto result = std::to_chars(buf_, buf_ + sizeof(buf_), value);
+            size_ = result.ptr - buf_;
+        }
+
+        piece(const piece &) = delete;
+
+        const char *data() const noexcept
+        { return local_ ? buf_ : data_; }
+
+        std::size_t size() const noexcept
+        { return size_; }
+    private:
+        const char *data_ { nullptr };
+        bool local_ { false };
+        std::size_t size_ { 0 };
+        char buf_[24];
+    };
+};
+
+}}
+
+#endif // PAYLOAD_HPP_INCLUDED
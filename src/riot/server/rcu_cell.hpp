@@ -0,0 +1,86 @@
+#ifndef RCU_CELL_HPP_INCLUDED
+#define RCU_CELL_HPP_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace riot { namespace server {
+
+/**
+ * @brief holds an immutable snapshot of T which is read without locks and
+ * replaced as a whole (read-copy-update).
+ *
+ * readers announce themselves in one of two counters, selected by the
+ * parity of the current epoch. a writer publishes the new snapshot, then
+ * waits for the readers of both parities, flipping the epoch before each
+ * wait, so that no reader which might have loaded the old snapshot is left
+ * when it's deleted. new readers always go to the counter not being waited
+ * for, so the writers are not starved.
+ *
+ * reads are wait-free, writes must be serialized by the caller.
+ *
+ * @param T snapshot type.
+ */
+template <typename T>
+class rcu_cell {
+public:
+    explicit rcu_cell(std::unique_ptr<const T> initial = std::make_unique<const T>()) :
+        current_(initial.release())
+    {}
+
+    rcu_cell(const rcu_cell &) = delete;
+    rcu_cell &operator=(const rcu_cell &) = delete;
+
+    ~rcu_cell() {
+        delete current_.load();
+    }
+
+    /**
+     * @brief calls f(const T &) with the current snapshot, which stays valid
+     * during the call.
+     *
+     * @return the result of f.
+     */
+    template <typename F>
+    decltype(auto) read(F &&f) const {
+        auto &readers = readers_[epoch_.load() & 1].count;
+        readers.fetch_add(1);
+        struct leave {
+            std::atomic<long> &readers;
+            ~leave() { readers.fetch_sub(1); }
+        } guard { readers };
+        return f(*current_.load());
+    }
+
+    /**
+     * @brief replaces the snapshot, waits for the readers of the old one
+     * and deletes it. must not be called concurrently with itself or from
+     * inside read().
+     *
+     * @param next new snapshot.
+     */
+    void publish(std::unique_ptr<const T> next) {
+        const T *old = current_.exchange(next.release());
+        for (int phase = 0; phase < 2; ++phase) {
+            auto &readers = readers_[epoch_.fetch_add(1) & 1].count;
+            while (readers.load() != 0)
+                std::this_thread::yield();
+        }
+        delete old;
+    }
+
+private:
+    struct alignas(64) counter {
+        std::atomic<long> count { 0 };
+    };
+
+    std::atomic<const T *> current_;
+    std::atomic<unsigned> epoch_ { 0 };
+    mutable counter readers_[2];
+};
+
+}}
+
+#endif // RCU_CELL_HPP_INCLUDED
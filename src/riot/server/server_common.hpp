@@ -3,9 +3,16 @@
 
 #include <memory>
 #include <list>
+#include <algorithm>
 #include <boost/asio.hpp>
 
 #include <src/riot/server/configuration.hpp>
+#include <src/riot/server/subscription_index.hpp>
+#include <src/riot/server/metrics.hpp>
+#include <src/riot/server/session_registry.hpp>
+#include <src/riot/server/p2p_directory.hpp>
+#include <src/riot/server/timer_wheel.hpp>
+#include <src/riot/server/auth_pool.hpp>
 
 namespace riot { namespace server {
 
@@ -20,27 +27,139 @@ using namespace boost::asio;
 template <typename Protocol>
 class server_common :
     public std::enable_shared_from_this<server_common<Protocol>>,
-    public strand {
+    public io_service::strand {
 public:
+    /**
+     * @brief state shared by the servers serving the same devices on
+     * different io_services, see server_pool.
+     * 
+     */
+    struct shared_state {
+        server_configuration config;
+        subscription_index<Protocol *> subscriptions;
+        session_registry<typename Protocol::ptr::element_type> registry;
+        p2p_directory<typename Protocol::ptr::element_type> p2p;
+        metrics_registry metrics;
+        auth_pool<std::shared_ptr<Protocol>> authenticator { &Protocol::login_batch };
+    };
+    
+    using shared_state_ptr = std::shared_ptr<shared_state>;
+    
     /**
      * @brief constructor.
      * 
      * @param io_service io_service object on which the strand is constructed.
+     * @param shared state shared with the other servers, a new one is
+     * created if null.
      */
-    server_common(io_service &io_service) :
-        strand(io_service),
+    server_common(io_service &io_service, shared_state_ptr shared = nullptr) :
+        io_service::strand(io_service),
+        shared_(shared ? std::move(shared) : std::make_shared<shared_state>()),
+        config(shared_->config),
+        subscriptions(shared_->subscriptions),
+        registry(shared_->registry),
+        p2p(shared_->p2p),
+        metrics(shared_->metrics),
+        authenticator(shared_->authenticator),
+        idle_timers(io_service, [](const auto &session, std::uint64_t now) {
+            return session->check_idle(now);
+        }),
+        flush_timers(io_service, [](const auto &session, std::uint64_t now) {
+            session->async_flush();
+            return std::uint64_t(0);    /* rescheduled by the session */
+        }),
         io_service_(io_service) {
     }
     
+private:
+    shared_state_ptr shared_;   /* must be initialized before the references */
+    
+    static constexpr std::size_t min_prune_at = 64;
+    std::size_t prune_at_ { min_prune_at };     /* size of sessions */
+    
+public:
     /**
-     * @brief list of the connections served by this server. connections should
-     * be added only if they are successfully started (this is automatically
-     * done if provided async_stream_protocol is used).
+     * @brief list of the connections served by this server, logged in or not.
+     * it's only used to stop them, must be accessed through the strand. the
+     * closed ones are pruned by add_session().
      * 
      */
     std::list<typename Protocol::wptr> sessions;
     
-    server_configuration config;
+    server_configuration &config;
+    
+    /**
+     * @brief subscriptions of all the sessions, used for routing the
+     * triggers. it is thread safe, no need to use the strand.
+     * 
+     */
+    subscription_index<Protocol *> &subscriptions;
+    
+    /**
+     * @brief logged in sessions by name and type. it is thread safe, lookups
+     * don't lock, no need to use the strand.
+     * 
+     */
+    session_registry<typename Protocol::ptr::element_type> &registry;
+    
+    /**
+     * @brief sessions accepting p2p transfers by p2pID. it is thread safe,
+     * no need to use the strand.
+     * 
+     */
+    p2p_directory<typename Protocol::ptr::element_type> &p2p;
+    
+    /**
+     * @brief counters and histograms of all the sessions, updated without
+     * locking from any thread.
+     * 
+     */
+    metrics_registry &metrics;
+    
+    /**
+     * @brief workers checking the credentials of the logins, shared by the
+     * servers of a server_pool. servers start it with themselves.
+     * 
+     */
+    auth_pool<std::shared_ptr<Protocol>> &authenticator;
+    
+    /**
+     * @brief idle timeouts of the sessions served by this server, i.e. by
+     * its io_service. servers start and stop it with themselves.
+     * 
+     */
+    timer_wheel<typename Protocol::ptr::element_type> idle_timers;
+    
+    /**
+     * @brief flushes of the events coalesced by the rate limited
+     * subscriptions of the sessions, shared by all of them.
+     * 
+     */
+    timer_wheel<typename Protocol::ptr::element_type> flush_timers;
+    
+    /**
+     * @brief returns the state shared with the other servers.
+     * 
+     * @return const shared_state_ptr&
+     */
+    const shared_state_ptr &shared() const
+    { return shared_; }
+    
+    /**
+     * @brief adds a session to sessions, through the strand. the expired
+     * entries are pruned each time the list has doubled since the last
+     * pruning, so it stays within twice the live sessions at an amortized
+     * constant cost.
+     * 
+     * @param session session accepted.
+     */
+    void add_session(typename Protocol::wptr session) {
+        sessions.push_back(std::move(session));
+        if (sessions.size() < prune_at_)
+            return ;
+        sessions.remove_if([](const auto &s) { return s.expired(); });
+        prune_at_ = std::max<std::size_t>(min_prune_at, 2 * sessions.size());
+    }
     
     /**
      * @brief applies a callable to each session in this server. please not that
@@ -75,6 +194,30 @@ public:
     }
 protected:
     io_service &io_service_;
+    
+    /**
+     * @brief opens a listening acceptor. with reuse_port, several acceptors,
+     * normally one per io_service, may listen on the same port and the
+     * kernel balances the incoming connections between them.
+     * 
+     */
+    static ip::tcp::acceptor open_acceptor(
+        io_service &io_service,
+        unsigned short port,
+        bool reuse_port) {
+        ip::tcp::endpoint endpoint(ip::tcp::v4(), port);
+        ip::tcp::acceptor acceptor(io_service);
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (reuse_port)
+            acceptor.set_option(detail::socket_option::boolean<
+                SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+        acceptor.bind(endpoint);
+        acceptor.listen();
+        return acceptor;
+    }
 };
 
 }};
@@ -0,0 +1,150 @@
+#ifndef SERVER_POOL_HPP_INCLUDED
+#define SERVER_POOL_HPP_INCLUDED
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cstddef>
+#include <boost/asio.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace riot { namespace server {
+
+using namespace boost::asio;
+
+/**
+ * @brief runs a server per io_service, and an io_service per thread, each
+ * thread pinned to a core.
+ *
+ * the servers listen on the same port with SO_REUSEPORT, so the kernel
+ * spreads the connections over them, and a connection lives on the thread
+ * accepting it. the servers share their state (configuration, registry,
+ * subscriptions), so the devices see a single server; triggers addressed to
+ * the sessions of other threads are carried in batches, see
+ * post_by_shard().
+ *
+ * @param Server server type, constructible with (io_service &, Args...,
+ * Server::shared_state_ptr).
+ */
+template <typename Server>
+class server_pool {
+public:
+    using shared_state = typename Server::shared_state;
+
+    /**
+     * @brief constructor, creates the io_services and the servers.
+     *
+     * @param shard_count number of the io_services, defaults to the number
+     * of cores.
+     * @param args arguments given to the constructor of each server.
+     */
+    template <typename ...Args>
+    server_pool(std::size_t shard_count, Args && ...args) :
+        shared_(std::make_shared<shared_state>()) {
+        if (shard_count == 0)
+            shard_count = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t i = 0; i < shard_count; ++i) {
+            services_.push_back(std::make_unique<io_service>(1));
+            servers_.push_back(std::make_unique<Server>(
+                *services_.back(), args..., shared_));
+        }
+    }
+
+    server_pool(const server_pool &) = delete;
+    server_pool &operator=(const server_pool &) = delete;
+
+    /**
+     * @brief destructor, stops the servers and waits for the threads.
+     *
+     */
+    ~server_pool() {
+        stop();
+        join();
+    }
+
+    /**
+     * @brief starts the servers and a thread per io_service. the threads run
+     * until stop() is called.
+     *
+     * @param pin true to pin the i-th thread to the i-th core.
+     */
+    void start(bool pin = true) {
+        for (std::size_t i = 0; i < services_.size(); ++i) {
+            works_.push_back(std::make_unique<io_service::work>(*services_[i]));
+            servers_[i]->start();
+            threads_.emplace_back([this, i, pin] {
+                if (pin)
+                    pin_to_core(i);
+                services_[i]->run();
+            });
+        }
+    }
+
+    /**
+     * @brief stops the servers, the threads return once their sessions are
+     * closed.
+     *
+     */
+    void stop() {
+        if (works_.empty())
+            return ;
+        for (auto &server: servers_)
+            server->stop();
+        works_.clear();
+    }
+
+    /**
+     * @brief waits for the threads to return.
+     *
+     */
+    void join() {
+        for (auto &t: threads_)
+            t.join();
+        threads_.clear();
+    }
+
+    std::size_t size() const
+    { return servers_.size(); }
+
+    Server &server(std::size_t i)
+    { return *servers_[i]; }
+
+    io_service &service(std::size_t i)
+    { return *services_[i]; }
+
+    /**
+     * @brief returns the state shared by the servers, e.g. to configure them.
+     *
+     * @return shared_state&
+     */
+    shared_state &shared()
+    { return *shared_; }
+private:
+    std::shared_ptr<shared_state> shared_;
+    /* the servers must be destroyed before their io_services */
+    std::vector<std::unique_ptr<io_service>> services_;
+    std::vector<std::unique_ptr<Server>> servers_;
+    std::vector<std::unique_ptr<io_service::work>> works_;
+    std::vector<std::thread> threads_;
+
+    static void pin_to_core(std::size_t i) {
+#ifdef __linux__
+        auto cores = std::thread::hardware_concurrency();
+        if (cores == 0)
+            return ;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(i % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+};
+
+}}
+
+#endif // SERVER_POOL_HPP_INCLUDED
@@ -0,0 +1,516 @@
+#ifndef SESSION_REGISTRY_HPP_INCLUDED
+#define SESSION_REGISTRY_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <array>
+#include <variant>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+#include <src/riot/server/rcu_cell.hpp>
+#include <src/riot/server/symbol_table.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief concurrent registry of the logged in sessions, keyed by the symbol
+ * of the device name.
+ *
+ * the names are distributed over shards, each shard is an rcu_cell holding
+ * an immutable snapshot of its part of the registry. lookups read the
+ * snapshots without locking, so they can be done from any strand.
+ * modifications lock only the shard of the name and publish a modified
+ * copy of it. a snapshot is a persistent radix tree over the symbols, which
+ * are dense: the copy shares all the nodes but the ones on the paths to
+ * the names modified, and the removals are batched.
+ *
+ * @param Session session type, the registry holds weak pointers to it.
+ */
+template <typename Session>
+class session_registry {
+public:
+    using ptr = std::shared_ptr<Session>;
+    using wptr = std::weak_ptr<Session>;
+
+    static constexpr std::size_t shard_count = 64;
+
+    enum insert_result {
+        inserted = 0,   /* the name was free */
+        replaced,       /* the name was held by a weak session, displaced */
+        taken           /* the name is held by a strong session */
+    };
+
+    /**
+     * @brief registers a session under the given name, unless the name is
+     * held by a live session having the strong name policy.
+     *
+     * @param name device name.
+     * @param type device type.
+     * @param weak true if the session gives up its name to later logins.
+     * @param session session to register.
+     * @param displaced set to the session which held the name, if any. it's
+     * the caller's duty to stop it.
+     * @return insert_result
+     */
+    insert_result insert(
+        symbol name,
+        symbol type,
+        bool weak,
+        const ptr &session,
+        ptr &displaced) {
+        /* sessions must not be released while holding the lock, their
+         * destructors erase their names */
+        ptr holder;
+        auto &s = shard_of(name);
+        std::lock_guard<std::mutex> lock(s.write_mutex);
+        wptr previous;
+        bool previous_weak = false;
+        s.cell.read([&](const shard_state &state) {
+            if (auto r = state.find(name)) {
+                previous = r->session;
+                previous_weak = r->weak;
+            }
+            return 0;
+        });
+        insert_result result = inserted;
+        if ((holder = previous.lock())) {
+            if (!previous_weak)
+                return taken;
+            displaced = holder;
+            result = replaced;
+        }
+        modify(s, [&](draft &next) {
+            next.slot(name) = record { session, session.get(), type, weak };
+        });
+        return result;
+    }
+
+    /**
+     * @brief a registration of insert_batch().
+     *
+     */
+    struct insert_request {
+        symbol name;
+        symbol type;
+        bool weak;
+        ptr session;
+        ptr displaced {};               /* set as by insert() */
+        insert_result result { inserted };
+    };
+
+    /**
+     * @brief registers the sessions as insert() would, one after the other,
+     * but locking and publishing each shard once for all of its names.
+     *
+     * @param requests registrations, their results are set.
+     */
+    void insert_batch(std::vector<insert_request> &requests) {
+        std::vector<insert_request *> order;
+        for (auto &r: requests)
+            order.push_back(&r);
+        std::stable_sort(order.begin(), order.end(),
+            [](const insert_request *a, const insert_request *b) {
+                return a->name % shard_count < b->name % shard_count;
+            });
+        for (auto it = order.begin(); it != order.end();) {
+            auto &s = shard_of((*it)->name);
+            auto end = std::find_if(it, order.end(), [&s, this](const insert_request *r) {
+                return &shard_of(r->name) != &s;
+            });
+            /* released after the lock, see insert() */
+            std::vector<ptr> holders;
+            std::lock_guard<std::mutex> lock(s.write_mutex);
+            modify(s, [&](draft &next) {
+                for (auto jt = it; jt != end; ++jt) {
+                    auto &r = **jt;
+                    if (auto found = next.state().find(r.name)) {
+                        if (auto holder = found->session.lock()) {
+                            holders.push_back(holder);
+                            if (!found->weak) {
+                                r.result = taken;
+                                continue;
+                            }
+                            r.displaced = std::move(holder);
+                            r.result = replaced;
+                        }
+                    }
+                    next.slot(r.name) = record { r.session, r.session.get(), r.type, r.weak };
+                }
+            });
+            it = end;
+        }
+    }
+
+    /**
+     * @brief registers a session under the name base_N, N being the smallest
+     * index not used by the other enumerated sessions of the same base name.
+     * indices are allocated in O(log n), names held by normal logins are
+     * skipped.
+     *
+     * @param base base name, given by the device.
+     * @param type device type.
+     * @param multiple_login false if the base name must not be shared.
+     * @param name set to the registered name, interned: the caller releases
+     * it.
+     * @param index set to the allocated index, to be given to release().
+     * @return insert_result taken if multiple_login is false and the base
+     * name is in use.
+     */
+    insert_result insert_enumerated(
+        symbol base,
+        symbol type,
+        bool weak,
+        bool multiple_login,
+        const ptr &session,
+        symbol &name,
+        std::uint64_t &index,
+        ptr &displaced) {
+        auto &s = shard_of(base);
+        std::vector<std::uint64_t> skipped;
+        insert_result result;
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(s.write_mutex);
+                auto &pool = s.pools[base];
+                if (pool.used != 0 && !multiple_login && skipped.empty())
+                    return taken;
+                index = pool.acquire();
+            }
+            /* the base lock is released, the name might be in the same shard */
+            name = symbols().intern(
+                symbols().str(base) + "_" + std::to_string(index));
+            result = insert(name, type, weak, session, displaced);
+            if (result != taken)
+                break;
+            symbols().release(name);
+            skipped.push_back(index);   /* held by a normal login */
+        }
+        for (auto i: skipped)
+            release(base, i);
+        return result;
+    }
+
+    /**
+     * @brief gives back an index allocated by insert_enumerated(). the name
+     * itself is removed by erase().
+     *
+     */
+    void release(symbol base, std::uint64_t index) {
+        auto &s = shard_of(base);
+        std::lock_guard<std::mutex> lock(s.write_mutex);
+        auto it = s.pools.find(base);
+        if (it != s.pools.end() && it->second.release(index))
+            s.pools.erase(it);
+    }
+
+    /**
+     * @brief removes the name if it is still held by the given session,
+     * which is being destroyed.
+     *
+     * the removal is invisible to the lookups, the weak pointers to the
+     * session having expired, so it's only queued: the removals are applied
+     * with the next modification of the shard, or once erase_batch of them
+     * are queued.
+     *
+     * @return bool true if removed.
+     */
+    bool erase(symbol name, const Session *session) {
+        auto &s = shard_of(name);
+        std::lock_guard<std::mutex> lock(s.write_mutex);
+        bool held = s.cell.read([&](const shard_state &state) {
+            auto r = state.find(name);
+            return r && r->raw == session;
+        });
+        if (!held)
+            return false;
+        s.erased.emplace_back(name, session);
+        if (s.erased.size() >= erase_batch)
+            modify(s, [](draft &) {});
+        return true;
+    }
+
+    /**
+     * @brief returns the live session having the given name, or null.
+     *
+     * @return ptr
+     */
+    ptr find(symbol name) const {
+        /* the result is moved out, never released inside the section */
+        return shard_of(name).cell.read([&](const shard_state &state) -> ptr {
+            auto r = state.find(name);
+            return r ? r->session.lock() : nullptr;
+        });
+    }
+
+    /**
+     * @brief returns true if the name is held by a live session.
+     *
+     * @return bool
+     */
+    bool contains(symbol name) const {
+        return shard_of(name).cell.read([&](const shard_state &state) {
+            auto r = state.find(name);
+            return r && !r->session.expired();
+        });
+    }
+
+    /**
+     * @brief calls f(ptr) for each live session. the sessions registered or
+     * removed meanwhile might or might not be visited.
+     *
+     */
+    template <typename F>
+    void for_each(F &&f) const {
+        for (const auto &s: shards_) {
+            /* called outside the read section, f might release them */
+            auto sessions = s.cell.read([](const shard_state &state) {
+                std::vector<ptr> result;
+                state.visit([&](const record &r) {
+                    if (auto session = r.session.lock())
+                        result.push_back(std::move(session));
+                });
+                return result;
+            });
+            for (auto &session: sessions)
+                f(session);
+        }
+    }
+
+    /**
+     * @brief calls f(ptr) for each live session of the given device type,
+     * scanning the registry.
+     *
+     */
+    template <typename F>
+    void for_each_of_type(symbol type, F &&f) const {
+        for (const auto &s: shards_) {
+            auto sessions = s.cell.read([&](const shard_state &state) {
+                std::vector<ptr> result;
+                state.visit([&](const record &r) {
+                    if (r.type != type)
+                        return ;
+                    if (auto session = r.session.lock())
+                        result.push_back(std::move(session));
+                });
+                return result;
+            });
+            for (auto &session: sessions)
+                f(session);
+        }
+    }
+
+    /**
+     * @brief returns the number of the names held by live sessions.
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const {
+        std::size_t n = 0;
+        for (const auto &s: shards_)
+            n += s.cell.read([](const shard_state &state) {
+                std::size_t live = 0;
+                state.visit([&](const record &r) {
+                    live += !r.session.expired();
+                });
+                return live;
+            });
+        return n;
+    }
+
+private:
+    /* empty if raw is null */
+    struct record {
+        wptr session;
+        const Session *raw { nullptr };
+        symbol type { no_symbol };
+        bool weak { false };
+    };
+
+    static constexpr unsigned radix_bits = 4;
+    static constexpr std::size_t fanout = std::size_t(1) << radix_bits;
+    static constexpr std::size_t erase_batch = 32;
+
+    struct node;
+    using node_ptr = std::shared_ptr<node>;
+    using children = std::array<node_ptr, fanout>;
+    using records = std::array<record, fanout>;
+
+    /* the inner nodes hold children, the leaves hold records. the nodes
+     * are never modified once published */
+    struct node {
+        std::variant<children, records> slots;
+    };
+
+    /* radix tree over the keys of the names */
+    struct shard_state {
+        node_ptr root;
+        unsigned height { 0 };  /* of the inner nodes above the leaves */
+
+        static std::size_t key_of(symbol name)
+        { return name / shard_count; }
+
+        static std::size_t index_of(std::size_t key, unsigned level)
+        { return (key >> (radix_bits * level)) % fanout; }
+
+        bool covers(std::size_t key) const
+        { return (key >> (radix_bits * (height + 1))) == 0; }
+
+        const record *find(symbol name) const {
+            auto key = key_of(name);
+            if (!root || !covers(key))
+                return nullptr;
+            const node *n = root.get();
+            for (unsigned level = height; level > 0; --level) {
+                n = std::get<children>(n->slots)[index_of(key, level)].get();
+                if (!n)
+                    return nullptr;
+            }
+            const record &r = std::get<records>(n->slots)[index_of(key, 0)];
+            return r.raw ? &r : nullptr;
+        }
+
+        /* calls f(const record &) for each record */
+        template <typename F>
+        void visit(F &&f) const
+        { visit(root.get(), height, f); }
+
+        template <typename F>
+        static void visit(const node *n, unsigned level, F &f) {
+            if (!n)
+                return ;
+            if (level == 0) {
+                for (const auto &r: std::get<records>(n->slots))
+                    if (r.raw)
+                        f(r);
+                return ;
+            }
+            for (const auto &child: std::get<children>(n->slots))
+                visit(child.get(), level - 1, f);
+        }
+    };
+
+    /* copy of a snapshot being modified, the nodes are copied on the first
+     * write */
+    class draft {
+    public:
+        explicit draft(const shard_state &state) :
+            next_(std::make_unique<shard_state>(state))
+        {}
+
+        const shard_state &state() const
+        { return *next_; }
+
+        /* the record of the name, empty if it's not registered */
+        record &slot(symbol name) {
+            auto key = shard_state::key_of(name);
+            while (!next_->covers(key)) {
+                if (next_->root) {
+                    auto root = make(false);
+                    std::get<children>(root->slots)[0] = std::move(next_->root);
+                    next_->root = std::move(root);
+                }
+                ++next_->height;
+            }
+            node_ptr *link = &next_->root;
+            for (unsigned level = next_->height; level > 0; --level)
+                link = &std::get<children>(own(*link, false).slots)[
+                    shard_state::index_of(key, level)];
+            return std::get<records>(own(*link, true).slots)[
+                shard_state::index_of(key, 0)];
+        }
+
+        std::unique_ptr<shard_state> release()
+        { return std::move(next_); }
+    private:
+        std::unique_ptr<shard_state> next_;
+        std::unordered_set<const node *> copies_;   /* not published yet */
+
+        node_ptr make(bool leaf) {
+            auto n = leaf ?
+                std::make_shared<node>(node { records() }) :
+                std::make_shared<node>(node { children() });
+            copies_.insert(n.get());
+            return n;
+        }
+
+        node &own(node_ptr &link, bool leaf) {
+            if (!link)
+                link = make(leaf);
+            else if (!copies_.count(link.get())) {
+                link = std::make_shared<node>(*link);
+                copies_.insert(link.get());
+            }
+            return *link;
+        }
+    };
+
+    /* indices of the enumerated names of a base name */
+    struct index_pool {
+        std::uint64_t next { 1 };
+        std::size_t used { 0 };
+        std::priority_queue<
+            std::uint64_t,
+            std::vector<std::uint64_t>,
+            std::greater<std::uint64_t>> freed;
+
+        std::uint64_t acquire() {
+            ++used;
+            if (freed.empty())
+                return next++;
+            auto index = freed.top();
+            freed.pop();
+            return index;
+        }
+
+        /* returns true if the pool is no longer used */
+        bool release(std::uint64_t index) {
+            freed.push(index);
+            return --used == 0;
+        }
+    };
+
+    struct shard {
+        std::mutex write_mutex;
+        rcu_cell<shard_state> cell;
+        /* only accessed by the writers, not a part of the snapshots */
+        std::unordered_map<symbol, index_pool> pools;
+        std::vector<std::pair<symbol, const Session *>> erased;  /* queued */
+    };
+
+    shard shards_[shard_count];
+
+    shard &shard_of(symbol name)
+    { return shards_[name % shard_count]; }
+
+    const shard &shard_of(symbol name) const
+    { return shards_[name % shard_count]; }
+
+    /* copy, apply the queued removals, modify, publish. requires the write
+     * mutex of the shard */
+    template <typename F>
+    static void modify(shard &s, F &&f) {
+        draft next = s.cell.read([](const shard_state &state) {
+            return draft(state);
+        });
+        for (const auto &e: s.erased) {
+            auto r = next.state().find(e.first);
+            if (r && r->raw == e.second)
+                next.slot(e.first) = record();
+        }
+        s.erased.clear();
+        f(next);
+        s.cell.publish(next.release());
+    }
+};
+
+}}
+
+#endif // SESSION_REGISTRY_HPP_INCLUDED
@@ -0,0 +1,237 @@
+#ifndef SMALL_VECTOR_HPP_INCLUDED
+#define SMALL_VECTOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <initializer_list>
+#include <memory_resource>
+
+namespace riot { namespace server {
+
+/**
+ * @brief vector keeping up to N elements inline, it only allocates when it
+ * grows beyond N elements, from its memory resource.
+ *
+ * as with the pmr containers, a copy allocates from the default resource
+ * (new and delete) and a moved vector keeps its resource, an assignment
+ * doesn't change the resource of the target.
+ *
+ * @param T element type.
+ * @param N inline capacity.
+ */
+template <typename T, std::size_t N>
+class small_vector {
+    static_assert(N > 0, "inline capacity must be positive");
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = T *;
+    using const_iterator = const T *;
+    using reference = T &;
+    using const_reference = const T &;
+
+    small_vector() noexcept
+    {}
+
+    /**
+     * @brief constructor.
+     *
+     * @param resource memory beyond the inline capacity, must outlive the
+     * vector.
+     */
+    explicit small_vector(std::pmr::memory_resource *resource) noexcept :
+        resource_(resource)
+    {}
+
+    small_vector(std::initializer_list<T> init) {
+        reserve(init.size());
+        for (const auto &t: init)
+            push_back(t);
+    }
+
+    small_vector(const small_vector &other) {
+        reserve(other.size_);
+        for (const auto &t: other)
+            push_back(t);
+    }
+
+    small_vector(small_vector &&other) noexcept(std::is_nothrow_move_constructible<T>::value) :
+        resource_(other.resource_) {
+        take(std::move(other));
+    }
+
+    small_vector &operator=(const small_vector &other) {
+        if (this != &other) {
+            clear();
+            reserve(other.size_);
+            for (const auto &t: other)
+                push_back(t);
+        }
+        return *this;
+    }
+
+    small_vector &operator=(small_vector &&other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (this != &other) {
+            clear();
+            release();
+            if (other.heap_ && !other.resource()->is_equal(*resource())) {
+                reserve(other.size_);
+                for (auto &t: other)
+                    push_back(std::move(t));
+                other.clear();
+            }
+            else
+                take(std::move(other));
+        }
+        return *this;
+    }
+
+    ~small_vector() {
+        clear();
+        release();
+    }
+
+    iterator begin() noexcept
+    { return data(); }
+    iterator end() noexcept
+    { return data() + size_; }
+    const_iterator begin() const noexcept
+    { return data(); }
+    const_iterator end() const noexcept
+    { return data() + size_; }
+
+    T *data() noexcept
+    { return heap_ ? heap_ : inline_data(); }
+    const T *data() const noexcept
+    { return heap_ ? heap_ : inline_data(); }
+
+    size_type size() const noexcept
+    { return size_; }
+    size_type capacity() const noexcept
+    { return capacity_; }
+    bool empty() const noexcept
+    { return size_ == 0; }
+
+    std::pmr::memory_resource *resource() const noexcept
+    { return resource_ ? resource_ : std::pmr::new_delete_resource(); }
+
+    reference operator[](size_type i)
+    { return data()[i]; }
+    const_reference operator[](size_type i) const
+    { return data()[i]; }
+
+    reference front()
+    { return data()[0]; }
+    const_reference front() const
+    { return data()[0]; }
+    reference back()
+    { return data()[size_ - 1]; }
+    const_reference back() const
+    { return data()[size_ - 1]; }
+
+    void reserve(size_type n) {
+        if (n <= capacity_)
+            return ;
+        T *p = static_cast<T *>(resource_ ?
+            resource_->allocate(n * sizeof(T), alignof(T)) :
+            ::operator new(n * sizeof(T)));
+        T *old = data();
+        for (size_type i = 0; i < size_; ++i) {
+            new (p + i) T(std::move_if_noexcept(old[i]));
+            old[i].~T();
+        }
+        release();
+        heap_ = p;
+        capacity_ = n;
+    }
+
+    template <typename ...Args>
+    reference emplace_back(Args && ...args) {
+        if (size_ == capacity_)
+            reserve(capacity_ * 2);
+        T *p = new (data() + size_) T(std::forward<Args>(args)...);
+        ++size_;
+        return *p;
+    }
+
+    void push_back(const T &t)
+    { emplace_back(t); }
+
+    void push_back(T &&t)
+    { emplace_back(std::move(t)); }
+
+    void pop_back() {
+        --size_;
+        data()[size_].~T();
+    }
+
+    /**
+     * @brief destroys the elements and frees the heap storage, the storage
+     * beyond the inline capacity comes from resource from now on.
+     *
+     */
+    void reset(std::pmr::memory_resource *resource) noexcept {
+        clear();
+        release();
+        resource_ = resource;
+    }
+
+    /**
+     * @brief destroys the elements, keeps the capacity.
+     *
+     */
+    void clear() noexcept {
+        T *p = data();
+        for (size_type i = 0; i < size_; ++i)
+            p[i].~T();
+        size_ = 0;
+    }
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type inline_[N];
+    T *heap_ { nullptr };
+    size_type size_ { 0 };
+    size_type capacity_ { N };
+    std::pmr::memory_resource *resource_ { nullptr };     /* new and delete */
+
+    T *inline_data() noexcept
+    { return reinterpret_cast<T *>(inline_); }
+    const T *inline_data() const noexcept
+    { return reinterpret_cast<const T *>(inline_); }
+
+    void release() noexcept {
+        if (heap_) {
+            if (resource_)
+                resource_->deallocate(heap_, capacity_ * sizeof(T), alignof(T));
+            else
+                ::operator delete(heap_);
+            heap_ = nullptr;
+            capacity_ = N;
+        }
+    }
+
+    /* requires *this to be empty and inline, and other's heap storage to be
+     * from an equal resource */
+    void take(small_vector &&other) {
+        if (other.heap_) {
+            heap_ = other.heap_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.heap_ = nullptr;
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+        else {
+            for (size_type i = 0; i < other.size_; ++i)
+                new (inline_data() + i) T(std::move(other.inline_data()[i]));
+            size_ = other.size_;
+            other.clear();
+        }
+    }
+};
+
+}}
+
+#endif // SMALL_VECTOR_HPP_INCLUDED
@@ -1,25 +1,33 @@
 #include <src/riot/server/ssl_server.hpp>
+#include <src/riot/server/tls_session_cache.hpp>
 
 namespace riot { namespace server {
 
 ssl_server_standalone::ssl_server_standalone(
     io_service &io_service,
     ssl::context &sslctx,
-    unsigned short port) :
+    unsigned short port,
+    shared_state_ptr shared) :
     server_common<async_stream_protocol<
         ssl::stream<ip::tcp::socket> & /* we can't use socket_type here */,
-        ssl_server_standalone>>(io_service),
+        ssl_server_standalone>>(io_service, shared),
     sslctx_(sslctx),
-    acceptor_(io_service_, tcp::endpoint(ip::tcp::v4(), port))
+    acceptor_(open_acceptor(io_service_, port, shared != nullptr))
 {
     
 }
 
 void ssl_server_standalone::start() {
+    idle_timers.start(std::chrono::milliseconds(config.idle_timer_resolution));
+    flush_timers.start(std::chrono::milliseconds(config.flush_timer_resolution));
+    authenticator.start(config.auth_threads);
+    tls_session_cache::install(sslctx_.native_handle(), config);
     do_accept();
 }
 
 void ssl_server_standalone::stop() {
+    idle_timers.stop();
+    flush_timers.stop();
     post([this] {
         acceptor_.cancel();
         for_each_session([this](auto session, bool remove) {
@@ -39,14 +47,26 @@ void ssl_server_standalone::do_accept() {
                 // most probably boost::asio::error::operation_aborted
                 return ;
             }
+            /* the handshake flights and the tickets are small writes, they
+             * must not wait for the delayed acks of the device */
+            connection_->lowest_layer().set_option(ip::tcp::no_delay(true));
+            metrics.add(metrics_registry::accepts);
             connection_->stream().async_handshake(ssl::stream_base::server,
-                wrap([this, connection = connection_](const error_code &ec) {
+                wrap([this, connection = connection_, accepted = std::chrono::steady_clock::now()]
+                (const error_code &ec) {
                     // this is wrapped by server only
                     if (ec) {
+                        metrics.add(metrics_registry::handshakes_failed);
                         return ;
                     }
+                    metrics.add(SSL_session_reused(connection->stream().native_handle()) ?
+                        metrics_registry::handshakes_resumed :
+                        metrics_registry::handshakes_full);
+                    metrics.record(metrics_registry::handshake_ns,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - accepted).count());
                     connection->start();   // no need for safety
-                    sessions.push_back(connection);
+                    add_session(connection);
             }));
             do_accept();
     });
@@ -56,8 +76,16 @@ ssl_server_standalone::connection::connection(ssl_server_standalone &server) :
     async_stream_protocol<
         ssl::stream<ip::tcp::socket> &,
         ssl_server_standalone>(server.io_service_, socket_, server),
-    socket_(server.io_service_, server.sslctx_) {
+    socket_(server.io_service_, server.sslctx_),
+    resume_unclean_(server.config.tls_resume_unclean) {
     
 }
 
+ssl_server_standalone::connection::~connection() {
+    /* openssl removes the session from the cache unless it's shut down,
+     * which this server never does: it's marked so after an orderly close */
+    if (closed_cleanly() || resume_unclean_)
+        SSL_set_shutdown(socket_.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+}
+
 }};
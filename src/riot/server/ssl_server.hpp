@@ -17,9 +17,19 @@ class ssl_server_standalone :
         ssl::stream<ip::tcp::socket> &,
         ssl_server_standalone>> {
 public:
+    /**
+     * @brief constructor.
+     * 
+     * @param io_service io_service serving the accepted connections.
+     * @param sslctx ssl context, it may be shared by the servers of a pool.
+     * @param port port to listen on.
+     * @param shared state shared with the other servers of a server_pool,
+     * which listen on the same port. null for a standalone server.
+     */
     ssl_server_standalone(
         io_service& io_service,
-        ssl::context& sslctx, short unsigned int port);
+        ssl::context& sslctx, short unsigned int port,
+        shared_state_ptr shared = nullptr);
     
     void start();
     
@@ -35,9 +45,11 @@ private:
             ssl::stream<ip::tcp::socket> &, ssl_server_standalone> {
     public:
         connection(ssl_server_standalone &server);
+        ~connection();
         using ptr = std::shared_ptr<connection>;
     private:
         ssl::stream<ip::tcp::socket> socket_;
+        const bool resume_unclean_;     /* see tls_resume_unclean */
     };
     
     friend class session;
@@ -0,0 +1,653 @@
+#ifndef SUBSCRIPTION_INDEX_HPP_INCLUDED
+#define SUBSCRIPTION_INDEX_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+
+#include <src/riot/server/xeid_matcher.hpp>
+#include <src/riot/server/symbol_table.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief index of the subscriptions of all the sessions of a server.
+ *
+ * every subscription is placed in exactly one bucket, chosen from the most
+ * selective component of its xeid:
+ *  - literal eid, dname or dtype: hash map keyed by that literal,
+ *  - eid of the form "prefix.*": trie keyed by the prefix,
+ *  - anything else (any, suffix or irregular patterns): a plain list scanned
+ *    with xeid_matcher::matches.
+ *
+ * the classification is the one done by xeid_pattern. the literals are
+ * interned into the global symbol table, so the buckets are keyed and the
+ * literal components are matched by symbols, the names and types of the
+ * devices are given as symbols too. a subscription holds the references to
+ * its literals until it's removed; the symbols of the events are looked up
+ * under the lock, so none of them can be reused meanwhile.
+ *
+ * routing an event only visits the buckets that can possibly match, so its
+ * cost is proportional to the number of candidate subscriptions rather than
+ * to the number of sessions.
+ *
+ * negative subscriptions (negsub) exclude the events matching them from all
+ * the subscriptions of their subscriber. they are compiled, when they are
+ * added and when a device is registered, into per subscriber bitsets over
+ * the registered devices, so routing checks an exclusion with a single bit
+ * probe; the eid patterns of the negsubs are matched only if the bit of the
+ * triggering device is set.
+ *
+ * all the member functions are thread safe. routing takes a shared lock,
+ * modifications take an exclusive lock.
+ *
+ * @param Subscriber hashable, copyable key identifying the subscriber.
+ */
+template <typename Subscriber>
+class subscription_index {
+public:
+    using subscriber_type = Subscriber;
+    using subscription_id = std::uint64_t;
+    using device_id = std::uint32_t;
+
+    /**
+     * @brief device id of the events of the unregistered devices, the
+     * negsubs are matched one by one for them.
+     *
+     */
+    static constexpr device_id no_device = ~device_id(0);
+
+    /**
+     * @brief adds a subscription.
+     *
+     * @param subscriber owner of the subscription.
+     * @param id identifier of the subscription, unique per subscriber.
+     * @param xeidm pattern the events are matched against.
+     * @param minperiod minimum period between the deliveries of the
+     * subscription in ms, 0 if not limited. it's only reported by route().
+     * @return bool false if the subscriber already has a subscription with
+     * the same id.
+     */
+    bool subscribe(
+        const Subscriber &subscriber,
+        subscription_id id,
+        xeid_matcher xeidm,
+        std::uint64_t minperiod = 0) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto &ids = by_subscriber_[subscriber];
+        if (ids.count(id))
+            return false;
+        std::uint32_t index;
+        if (free_.empty()) {
+            index = static_cast<std::uint32_t>(entries_.size());
+            entries_.emplace_back();
+        }
+        else {
+            index = free_.back();
+            free_.pop_back();
+        }
+        entry &e = entries_[index];
+        e.subscriber = subscriber;
+        e.id = id;
+        e.xeidm = std::move(xeidm);
+        e.literals = literals_of(e.xeidm);
+        e.minperiod = minperiod;
+        auto excl = exclusions_.find(subscriber);
+        e.excl = excl == exclusions_.end() ? nullptr : &excl->second;
+        e.used = true;
+        insert_to_bucket(index);
+        ids.emplace(id, index);
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief removes a subscription.
+     *
+     * @return bool false if no such subscription exists.
+     */
+    bool unsubscribe(const Subscriber &subscriber, subscription_id id) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = by_subscriber_.find(subscriber);
+        if (it == by_subscriber_.end())
+            return false;
+        auto jt = it->second.find(id);
+        if (jt == it->second.end())
+            return false;
+        release(jt->second);
+        it->second.erase(jt);
+        if (it->second.empty())
+            by_subscriber_.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief removes all the subscriptions of a subscriber.
+     *
+     * @return std::size_t number of the removed subscriptions.
+     */
+    std::size_t unsubscribe_all(const Subscriber &subscriber) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = by_subscriber_.find(subscriber);
+        if (it == by_subscriber_.end())
+            return 0;
+        std::size_t n = it->second.size();
+        for (auto &p: it->second)
+            release(p.second);
+        by_subscriber_.erase(it);
+        return n;
+    }
+
+    /**
+     * @brief adds a negative subscription, the events matching xeidm are not
+     * routed to any subscription of the subscriber.
+     *
+     * @param id identifier of the negsub, unique per subscriber.
+     * @return bool false if the subscriber already has a negsub with the
+     * same id.
+     */
+    bool negsubscribe(
+        const Subscriber &subscriber,
+        subscription_id id,
+        xeid_matcher xeidm) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = exclusions_.find(subscriber);
+        if (it == exclusions_.end()) {
+            it = exclusions_.emplace(subscriber, exclusion()).first;
+            set_exclusion(subscriber, &it->second);
+        }
+        auto &excl = it->second;
+        for (const auto &n: excl.negsubs)
+            if (n.id == id)
+                return false;
+        bool every_eid = xeidm.eid_pattern().kind() == xeid_pattern::any;
+        negsub n { id, std::move(xeidm), {}, every_eid };
+        n.literals = literals_of(n.xeidm);
+        for (device_id d = 0; d < devices_.size(); ++d) {
+            const auto &dev = devices_[d];
+            if (dev.used && n.device_matches(dev.name, dev.type))
+                excl.set(d, every_eid);
+        }
+        excl.negsubs.push_back(std::move(n));
+        return true;
+    }
+
+    /**
+     * @brief removes a negative subscription.
+     *
+     * @return bool false if no such negsub exists.
+     */
+    bool unnegsubscribe(const Subscriber &subscriber, subscription_id id) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = exclusions_.find(subscriber);
+        if (it == exclusions_.end())
+            return false;
+        auto &negsubs = it->second.negsubs;
+        auto jt = std::find_if(negsubs.begin(), negsubs.end(),
+            [id](const negsub &n) { return n.id == id; });
+        if (jt == negsubs.end())
+            return false;
+        release_literals(jt->literals);
+        negsubs.erase(jt);
+        if (negsubs.empty()) {
+            set_exclusion(subscriber, nullptr);
+            exclusions_.erase(it);
+        }
+        else
+            recompile(it->second);
+        return true;
+    }
+
+    /**
+     * @brief removes all the negative subscriptions of a subscriber.
+     *
+     * @return std::size_t number of the removed negsubs.
+     */
+    std::size_t unnegsubscribe_all(const Subscriber &subscriber) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = exclusions_.find(subscriber);
+        if (it == exclusions_.end())
+            return 0;
+        std::size_t n = it->second.negsubs.size();
+        for (const auto &neg: it->second.negsubs)
+            release_literals(neg.literals);
+        set_exclusion(subscriber, nullptr);
+        exclusions_.erase(it);
+        return n;
+    }
+
+    /**
+     * @brief registers a device, which may trigger events, and computes the
+     * negsubs excluding it.
+     *
+     * @return device_id dense id of the device, reused after
+     * unregister_device().
+     */
+    device_id register_device(symbol name, symbol type) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        device_id d;
+        if (free_devices_.empty()) {
+            d = static_cast<device_id>(devices_.size());
+            devices_.emplace_back();
+        }
+        else {
+            d = free_devices_.back();
+            free_devices_.pop_back();
+        }
+        devices_[d] = device { name, type, true };
+        for (auto &p: exclusions_)
+            p.second.compile(d, name, type);
+        return d;
+    }
+
+    /**
+     * @brief unregisters a device, its id is given to a later device.
+     *
+     */
+    void unregister_device(device_id d) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (d >= devices_.size() || !devices_[d].used)
+            return ;
+        devices_[d] = device();
+        free_devices_.push_back(d);
+    }
+
+    /**
+     * @brief calls f(subscriber, id, minperiod) for each subscription
+     * matching the event. a subscriber having several matching subscriptions
+     * is reported once per subscription. the subscribers having a negsub
+     * matching the event are skipped.
+     *
+     * f is called while the index is locked for reading, it must not call
+     * back into the index.
+     *
+     * @param eid event identifier.
+     * @param dname name of the triggering device.
+     * @param dtype type of the triggering device.
+     * @param device id of the triggering device, see register_device().
+     * @param f callable object.
+     */
+    template <typename F>
+    void route(
+        const std::string &eid,
+        symbol dname,
+        symbol dtype,
+        device_id device,
+        F &&f) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const auto &table = symbols();
+        route_event(
+            event { eid, table.find(eid),
+                    table.str(dname), dname,
+                    table.str(dtype), dtype },
+            device, f);
+    }
+
+    /**
+     * @brief routes the event of an unregistered device.
+     *
+     */
+    template <typename F>
+    void route(
+        const std::string &eid,
+        const std::string &dname,
+        const std::string &dtype,
+        F &&f) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const auto &table = symbols();
+        route_event(
+            event { eid, table.find(eid),
+                    dname, table.find(dname),
+                    dtype, table.find(dtype) },
+            no_device, f);
+    }
+
+    /**
+     * @brief returns the number of the subscriptions.
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return size_;
+    }
+
+private:
+    using bucket_type = std::vector<std::uint32_t>;
+
+    /* an event, its components and their symbols (no_symbol if never
+     * interned, then no literal can match it) */
+    struct event {
+        const std::string &eid;
+        symbol eid_sym;
+        const std::string &dname;
+        symbol dname_sym;
+        const std::string &dtype;
+        symbol dtype_sym;
+    };
+
+    /* symbols of the literal components of an xeid, no_symbol for the
+     * others */
+    struct literal_symbols {
+        symbol eid { no_symbol };
+        symbol dname { no_symbol };
+        symbol dtype { no_symbol };
+    };
+
+    static symbol literal_of(const xeid_pattern &p) {
+        return p.kind() == xeid_pattern::literal ?
+            symbols().intern(p.key()) : no_symbol;
+    }
+
+    static literal_symbols literals_of(const xeid_matcher &xeidm) {
+        return literal_symbols {
+            literal_of(xeidm.eid_pattern()),
+            literal_of(xeidm.dname_pattern()),
+            literal_of(xeidm.dtype_pattern()) };
+    }
+
+    /* drops the references taken by literals_of() */
+    static void release_literals(const literal_symbols &literals) {
+        auto &table = symbols();
+        table.release(literals.eid);
+        table.release(literals.dname);
+        table.release(literals.dtype);
+    }
+
+    /* literals are compared as symbols, the other patterns are matched */
+    static bool component_matches(
+        symbol literal,
+        const xeid_pattern &p,
+        const std::string &str,
+        symbol sym) {
+        return literal != no_symbol ? literal == sym : p.matches(str);
+    }
+
+    static bool xeid_matches(
+        const xeid_matcher &xeidm,
+        const literal_symbols &literals,
+        const event &ev) {
+        return
+            component_matches(literals.eid, xeidm.eid_pattern(), ev.eid, ev.eid_sym) &&
+            component_matches(literals.dname, xeidm.dname_pattern(), ev.dname, ev.dname_sym) &&
+            component_matches(literals.dtype, xeidm.dtype_pattern(), ev.dtype, ev.dtype_sym);
+    }
+
+    template <typename F>
+    /* requires the shared lock */
+    void route_event(const event &ev, device_id device, F &f) const {
+        auto visit = [&](const bucket_type &bucket) {
+            for (auto index: bucket) {
+                const entry &e = entries_[index];
+                if (xeid_matches(e.xeidm, e.literals, ev) &&
+                    !(e.excl && e.excl->excludes(device, ev)))
+                    f(e.subscriber, e.id, e.minperiod);
+            }
+        };
+        visit_exact(eid_exact_, ev.eid_sym, visit);
+        visit_exact(dname_exact_, ev.dname_sym, visit);
+        visit_exact(dtype_exact_, ev.dtype_sym, visit);
+        const trie_node *node = &eid_prefix_;
+        for (char c: ev.eid) {
+            auto it = node->children.find(c);
+            if (it == node->children.end())
+                break;
+            node = it->second.get();
+            visit(node->entries);
+        }
+        visit(scan_);
+    }
+
+    struct trie_node {
+        trie_node *parent { nullptr };
+        char key { 0 };
+        std::map<char, std::unique_ptr<trie_node>> children;
+        bucket_type entries;
+    };
+
+    enum bucket_kind {
+        in_eid_exact,
+        in_dname_exact,
+        in_dtype_exact,
+        in_eid_prefix,
+        in_scan
+    };
+
+    struct negsub {
+        subscription_id id;
+        xeid_matcher xeidm;
+        literal_symbols literals;
+        bool every_eid;     /* only the device matters */
+
+        bool device_matches(symbol name, symbol type) const {
+            const auto &table = symbols();
+            return
+                component_matches(literals.dname, xeidm.dname_pattern(), table.str(name), name) &&
+                component_matches(literals.dtype, xeidm.dtype_pattern(), table.str(type), type);
+        }
+    };
+
+    using bitset_type = std::vector<std::uint64_t>;
+
+    /* negsubs of a subscriber, and their bitsets over the device ids */
+    struct exclusion {
+        std::vector<negsub> negsubs;
+        bitset_type every_eid;  /* devices excluded for all the events */
+        bitset_type some_eid;   /* devices excluded for some eids */
+
+        static bool test(const bitset_type &bits, device_id d) {
+            auto word = d / 64;
+            return word < bits.size() && (bits[word] >> (d % 64) & 1);
+        }
+
+        static void assign(bitset_type &bits, device_id d, bool value) {
+            auto word = d / 64;
+            if (word >= bits.size()) {
+                if (!value)
+                    return ;
+                bits.resize(word + 1);
+            }
+            if (value)
+                bits[word] |= std::uint64_t(1) << (d % 64);
+            else
+                bits[word] &= ~(std::uint64_t(1) << (d % 64));
+        }
+
+        void set(device_id d, bool every) {
+            assign(every ? every_eid : some_eid, d, true);
+        }
+
+        /* computes the bits of a (re)registered device */
+        void compile(device_id d, symbol name, symbol type) {
+            bool every = false, some = false;
+            for (const auto &n: negsubs) {
+                if (n.device_matches(name, type)) {
+                    every |= n.every_eid;
+                    some |= !n.every_eid;
+                }
+            }
+            assign(every_eid, d, every);
+            assign(some_eid, d, some);
+        }
+
+        bool excludes(device_id d, const event &ev) const {
+            if (d != no_device) {
+                if (test(every_eid, d))
+                    return true;
+                if (!test(some_eid, d))
+                    return false;
+            }
+            for (const auto &n: negsubs)
+                if (xeid_matches(n.xeidm, n.literals, ev))
+                    return true;
+            return false;
+        }
+    };
+
+    struct device {
+        symbol name { no_symbol };
+        symbol type { no_symbol };
+        bool used { false };
+    };
+
+    struct entry {
+        Subscriber subscriber {};
+        subscription_id id { 0 };
+        xeid_matcher xeidm;
+        literal_symbols literals;
+        std::uint64_t minperiod { 0 };
+        const exclusion *excl { nullptr };  /* of the subscriber, if any */
+        bucket_type *bucket { nullptr };
+        trie_node *node { nullptr };
+        bucket_kind where { in_scan };
+        std::uint32_t position { 0 };
+        bool used { false };
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::vector<entry> entries_;
+    std::vector<std::uint32_t> free_;
+    std::size_t size_ { 0 };
+
+    std::unordered_map<symbol, bucket_type> eid_exact_;
+    std::unordered_map<symbol, bucket_type> dname_exact_;
+    std::unordered_map<symbol, bucket_type> dtype_exact_;
+    trie_node eid_prefix_;
+    bucket_type scan_;
+
+    std::unordered_map<
+        Subscriber,
+        std::unordered_map<subscription_id, std::uint32_t>> by_subscriber_;
+
+    /* node based, the entries point to the values */
+    std::unordered_map<Subscriber, exclusion> exclusions_;
+    std::vector<device> devices_;
+    std::vector<device_id> free_devices_;
+
+    void set_exclusion(const Subscriber &subscriber, const exclusion *excl) {
+        auto it = by_subscriber_.find(subscriber);
+        if (it == by_subscriber_.end())
+            return ;
+        for (auto &p: it->second)
+            entries_[p.second].excl = excl;
+    }
+
+    void recompile(exclusion &excl) {
+        excl.every_eid.clear();
+        excl.some_eid.clear();
+        for (device_id d = 0; d < devices_.size(); ++d)
+            if (devices_[d].used)
+                excl.compile(d, devices_[d].name, devices_[d].type);
+    }
+
+    template <typename Map, typename Visit>
+    static void visit_exact(const Map &map, symbol key, Visit &visit) {
+        if (map.empty() || key == no_symbol)
+            return ;
+        auto it = map.find(key);
+        if (it != map.end())
+            visit(it->second);
+    }
+
+    void insert_to_bucket(std::uint32_t index) {
+        entry &e = entries_[index];
+        const auto &eid = e.xeidm.eid_pattern();
+        const auto &dname = e.xeidm.dname_pattern();
+        const auto &dtype = e.xeidm.dtype_pattern();
+        bucket_type *bucket;
+        e.node = nullptr;
+        if (eid.kind() == xeid_pattern::literal) {
+            e.where = in_eid_exact;
+            bucket = &eid_exact_[e.literals.eid];
+        }
+        else if (dname.kind() == xeid_pattern::literal) {
+            e.where = in_dname_exact;
+            bucket = &dname_exact_[e.literals.dname];
+        }
+        else if (dtype.kind() == xeid_pattern::literal) {
+            e.where = in_dtype_exact;
+            bucket = &dtype_exact_[e.literals.dtype];
+        }
+        else if (eid.kind() == xeid_pattern::prefix) {
+            trie_node *node = &eid_prefix_;
+            for (char c: eid.key()) {
+                auto &child = node->children[c];
+                if (!child) {
+                    child = std::make_unique<trie_node>();
+                    child->parent = node;
+                    child->key = c;
+                }
+                node = child.get();
+            }
+            e.where = in_eid_prefix;
+            e.node = node;
+            bucket = &node->entries;
+        }
+        else {
+            e.where = in_scan;
+            bucket = &scan_;
+        }
+        e.bucket = bucket;
+        e.position = static_cast<std::uint32_t>(bucket->size());
+        bucket->push_back(index);
+    }
+
+    void release(std::uint32_t index) {
+        entry &e = entries_[index];
+        bucket_type &bucket = *e.bucket;
+        /* swap-remove, fixing the position of the moved entry */
+        std::uint32_t last = bucket.back();
+        bucket[e.position] = last;
+        entries_[last].position = e.position;
+        bucket.pop_back();
+        if (bucket.empty())
+            erase_empty_bucket(e);
+        release_literals(e.literals);
+        e.literals = literal_symbols();
+        e.used = false;
+        e.bucket = nullptr;
+        e.node = nullptr;
+        free_.push_back(index);
+        --size_;
+    }
+
+    void erase_empty_bucket(const entry &e) {
+        /* literal patterns are keyed by their symbols */
+        switch (e.where) {
+        case in_eid_exact:
+            eid_exact_.erase(e.literals.eid);
+            break;
+        case in_dname_exact:
+            dname_exact_.erase(e.literals.dname);
+            break;
+        case in_dtype_exact:
+            dtype_exact_.erase(e.literals.dtype);
+            break;
+        case in_eid_prefix: {
+            /* prune the trie branch which has become useless */
+            trie_node *node = e.node;
+            while (node->parent &&
+                   node->entries.empty() &&
+                   node->children.empty()) {
+                trie_node *parent = node->parent;
+                parent->children.erase(node->key);
+                node = parent;
+            }
+            break;
+        }
+        case in_scan:
+            break;
+        }
+    }
+};
+
+}}
+
+#endif // SUBSCRIPTION_INDEX_HPP_INCLUDED
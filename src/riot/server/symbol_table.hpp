@@ -0,0 +1,207 @@
+#ifndef SYMBOL_TABLE_HPP_INCLUDED
+#define SYMBOL_TABLE_HPP_INCLUDED
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace riot { namespace server {
+
+/**
+ * @brief 32-bit identifier of an interned string.
+ *
+ */
+using symbol = std::uint32_t;
+
+/**
+ * @brief symbol of no string, never returned by intern().
+ *
+ */
+constexpr symbol no_symbol = ~symbol(0);
+
+/**
+ * @brief interns strings (device names and types, literal eids) into dense
+ * 32-bit symbols, so that they are stored once and compared as integers.
+ *
+ * the symbols are reference counted: each intern() is paired with a
+ * release(), and the string is freed when its last reference is released,
+ * its symbol being given to a later string. the freed symbols are reused
+ * in the order they were freed, so that a stale symbol doesn't designate
+ * another string soon. str() doesn't lock, the strings are stored in chunks
+ * which never move; it may only be called on a symbol the caller holds a
+ * reference to.
+ *
+ * all the member functions are thread safe.
+ */
+class symbol_table {
+public:
+    symbol_table() = default;
+    symbol_table(const symbol_table &) = delete;
+    symbol_table &operator=(const symbol_table &) = delete;
+
+    ~symbol_table() {
+        for (std::size_t i = 0; i < max_chunks; ++i)
+            delete[] chunks_[i].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief returns the symbol of the string, adding it if it's new, and
+     * takes a reference to it.
+     *
+     * @return symbol
+     */
+    symbol intern(std::string_view str) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = ids_.find(str);
+            if (it != ids_.end()) {
+                /* release() takes the exclusive lock, it can't drop it
+                 * meanwhile */
+                slot_of(it->second).refs.fetch_add(1, std::memory_order_relaxed);
+                return it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(str);
+        if (it != ids_.end()) {
+            slot_of(it->second).refs.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+        symbol id;
+        if (free_.empty())
+            id = end_++;
+        else {
+            id = free_.front();
+            free_.pop_front();
+        }
+        auto &chunk = chunks_[id / chunk_size];
+        slot *slots = chunk.load(std::memory_order_relaxed);
+        if (!slots) {
+            slots = new slot[chunk_size];
+            chunk.store(slots, std::memory_order_release);
+        }
+        slot &stored = slots[id % chunk_size];
+        stored.str.assign(str.data(), str.size());
+        stored.refs.store(1, std::memory_order_relaxed);
+        ids_.emplace(std::string_view(stored.str), id);
+        return id;
+    }
+
+    /**
+     * @brief returns the symbol of the string and takes a reference to it,
+     * or no_symbol if the string isn't interned, in which case nothing is
+     * added.
+     *
+     * @return symbol
+     */
+    symbol acquire(std::string_view str) {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(str);
+        if (it == ids_.end())
+            return no_symbol;
+        slot_of(it->second).refs.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+
+    /**
+     * @brief releases a reference taken by intern() or acquire(), the
+     * string is freed with the last one. only the last one locks.
+     *
+     * @param id symbol given by intern() or acquire(), no_symbol is ignored.
+     */
+    void release(symbol id) {
+        if (id == no_symbol)
+            return ;
+        slot &stored = slot_of(id);
+        /* the holder is done reading the string once its reference is
+         * given back, hence release, and acquire for the one freeing it */
+        auto n = stored.refs.load(std::memory_order_relaxed);
+        while (n > 1)
+            if (stored.refs.compare_exchange_weak(
+                    n, n - 1, std::memory_order_release, std::memory_order_relaxed))
+                return ;
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (stored.refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return ;
+        ids_.erase(std::string_view(stored.str));
+        std::string().swap(stored.str);
+        free_.push_back(id);
+    }
+
+    /**
+     * @brief returns the symbol of the string, or no_symbol if it has never
+     * been interned. no reference is taken, see acquire().
+     *
+     * @return symbol
+     */
+    symbol find(std::string_view str) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(str);
+        return it == ids_.end() ? no_symbol : it->second;
+    }
+
+    /**
+     * @brief returns the string of a symbol given by this table.
+     *
+     * @return const std::string&
+     */
+    const std::string &str(symbol id) const {
+        return slot_of(id).str;
+    }
+
+    /**
+     * @brief returns the number of the interned strings not released.
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return ids_.size();
+    }
+
+    /**
+     * @brief returns the table shared by all the servers.
+     *
+     * @return symbol_table&
+     */
+    static symbol_table &global() {
+        static symbol_table table;
+        return table;
+    }
+private:
+    static constexpr std::size_t chunk_size = 65536;
+    static constexpr std::size_t max_chunks = (std::size_t(1) << 32) / chunk_size;
+
+    struct slot {
+        std::string str;
+        std::atomic<std::uint32_t> refs { 0 };
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string_view, symbol> ids_;
+    std::deque<symbol> free_;   /* released, reused first in first out */
+    symbol end_ { 0 };          /* symbols never given yet */
+    std::unique_ptr<std::atomic<slot *>[]> chunks_ {
+        new std::atomic<slot *>[max_chunks]() };
+
+    slot &slot_of(symbol id) const
+    { return chunks_[id / chunk_size].load(std::memory_order_acquire)[id % chunk_size]; }
+};
+
+/**
+ * @brief shorthand for symbol_table::global().
+ *
+ */
+inline symbol_table &symbols()
+{ return symbol_table::global(); }
+
+}}
+
+#endif // SYMBOL_TABLE_HPP_INCLUDED
@@ -0,0 +1,190 @@
+#ifndef TIMER_WHEEL_HPP_INCLUDED
+#define TIMER_WHEEL_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace riot { namespace server {
+
+using namespace boost::asio;
+
+/**
+ * @brief hashed timer wheel, a single asio timer ticking for many targets.
+ *
+ * the time is counted in ticks of a fixed resolution. a target is put in
+ * the slot of its deadline (modulo the number of the slots) and is looked
+ * at only when its slot comes; the targets whose deadline is further away
+ * than a turn of the wheel are kept in the slot until the right turn.
+ *
+ * the deadline is not moved when the target is active: the target records
+ * now() as its last activity, which is a relaxed atomic load, and is asked
+ * on its deadline whether it's really expired or when to look at it again.
+ *
+ * @param T target type, held by weak pointers.
+ */
+template <typename T>
+class timer_wheel {
+public:
+    using target_ptr = std::shared_ptr<T>;
+
+    /**
+     * @brief called with a target whose deadline has come. returns its next
+     * deadline (in ticks), or 0 to forget about it.
+     *
+     */
+    using expire_function = std::function<std::uint64_t(const target_ptr &, std::uint64_t)>;
+
+    static constexpr std::size_t slot_count = 512;
+
+    timer_wheel(io_service &io_service, expire_function expire) :
+        strand_(io_service),
+        timer_(io_service),
+        expire_(std::move(expire)),
+        slots_(slot_count)
+    {}
+
+    /**
+     * @brief starts ticking.
+     *
+     * @param resolution duration of a tick.
+     */
+    void start(std::chrono::milliseconds resolution) {
+        resolution_ = resolution.count() > 0 ? resolution : std::chrono::milliseconds(1);
+        strand_.post([this] {
+            running_ = true;
+            next_tick_ = std::chrono::steady_clock::now() + resolution_;
+            arm();
+        });
+    }
+
+    /**
+     * @brief stops ticking, the targets are not expired anymore.
+     *
+     */
+    void stop() {
+        strand_.post([this] {
+            running_ = false;
+            timer_.cancel();
+        });
+    }
+
+    /**
+     * @brief returns the current tick, to be recorded as the last activity.
+     *
+     * @return std::uint64_t
+     */
+    std::uint64_t now() const
+    { return now_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief returns the number of the ticks covering the given duration.
+     *
+     * @return std::uint64_t
+     */
+    std::uint64_t ticks(std::chrono::milliseconds duration) const {
+        auto r = resolution_.count();
+        return (duration.count() + r - 1) / r;
+    }
+
+    /**
+     * @brief adds a target expiring at the given tick.
+     *
+     */
+    void schedule(const target_ptr &target, std::uint64_t deadline) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert(entry { target, deadline });
+    }
+
+    /**
+     * @brief returns the number of the targets in the wheel.
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return size_;
+    }
+
+    /**
+     * @brief advances the wheel by a tick, expiring the targets due. it's
+     * normally called by the timer.
+     *
+     */
+    void tick() {
+        auto now = now_.load(std::memory_order_relaxed) + 1;
+        now_.store(now, std::memory_order_relaxed);
+        std::vector<entry> due, later;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &slot = slots_[now % slot_count];
+            for (auto &e: slot) {
+                if (e.deadline <= now)
+                    due.push_back(std::move(e));
+                else if (!e.target.expired())
+                    later.push_back(std::move(e));   /* a later turn */
+            }
+            size_ -= slot.size() - later.size();
+            slot.swap(later);
+        }
+        /* outside the lock, the targets may schedule or be released */
+        for (auto &e: due) {
+            auto target = e.target.lock();
+            if (!target)
+                continue;
+            auto next = expire_(target, now);
+            if (next == 0)
+                continue;
+            std::lock_guard<std::mutex> lock(mutex_);
+            insert(entry { std::move(e.target), next > now ? next : now + 1 });
+        }
+    }
+private:
+    struct entry {
+        std::weak_ptr<T> target;
+        std::uint64_t deadline;
+    };
+
+    io_service::strand strand_;    /* of the timer */
+    steady_timer timer_;
+    expire_function expire_;
+    std::chrono::milliseconds resolution_ { 1000 };
+    std::chrono::steady_clock::time_point next_tick_;
+    bool running_ { false };       /* accessed through the strand */
+    std::atomic<std::uint64_t> now_ { 0 };
+
+    mutable std::mutex mutex_;
+    std::vector<std::vector<entry>> slots_;
+    std::size_t size_ { 0 };
+
+    void insert(entry e) {
+        slots_[e.deadline % slot_count].push_back(std::move(e));
+        ++size_;
+    }
+
+    void arm() {
+        timer_.expires_at(next_tick_);
+        timer_.async_wait(strand_.wrap([this](const boost::system::error_code &ec) {
+            if (ec || !running_)
+                return ;
+            /* catch up if the thread was busy, without drifting */
+            auto now = std::chrono::steady_clock::now();
+            while (next_tick_ <= now) {
+                tick();
+                next_tick_ += resolution_;
+            }
+            arm();
+        }));
+    }
+};
+
+}}
+
+#endif // TIMER_WHEEL_HPP_INCLUDED
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <src/riot/server/tls_session_cache.hpp>
+
+using namespace std;
+
+namespace riot { namespace server {
+
+namespace {
+
+const unsigned char session_id_context[] = "riotserver3";
+
+mutex install_mutex;
+
+void free_cache(void *, void *cache, CRYPTO_EX_DATA *, int, long, void *)
+{
+    delete static_cast<tls_session_cache *>(cache);
+}
+
+/* the slot of the installed cache in the context */
+int cache_index()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_cache);
+    return index;
+}
+
+bool set_mac_key(EVP_MAC_CTX *mac, const array<unsigned char, 32> &key)
+{
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+            const_cast<unsigned char *>(key.data()), key.size()),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+            const_cast<char *>("SHA256"), 0),
+        OSSL_PARAM_construct_end()
+    };
+    return EVP_MAC_CTX_set_params(mac, params) == 1;
+}
+
+}
+
+tls_session_cache &tls_session_cache::install(SSL_CTX *ctx, const server_configuration &config)
+{
+    lock_guard<mutex> lock(install_mutex);
+    auto installed = static_cast<tls_session_cache *>(SSL_CTX_get_ex_data(ctx, cache_index()));
+    if (installed)
+        return *installed;
+    auto cache = new tls_session_cache(config);
+    SSL_CTX_set_ex_data(ctx, cache_index(), cache);
+    SSL_CTX_set_session_id_context(ctx, session_id_context, sizeof(session_id_context) - 1);
+    SSL_CTX_set_timeout(ctx, config.tls_session_timeout);
+    if (config.tls_session_cache_size != 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, config.tls_session_cache_size);
+    }
+    else
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    if (config.tls_tickets)
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_callback);
+    else
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    /* a device resumes from its last ticket only */
+    SSL_CTX_set_num_tickets(ctx, 1);
+    return *cache;
+}
+
+tls_session_cache::tls_session_cache(const server_configuration &config) :
+    key_lifetime_(config.tls_ticket_key_lifetime),
+    max_keys_(max<size_t>(1, config.tls_ticket_keys))
+{
+    rotate();
+}
+
+void tls_session_cache::rotate()
+{
+    lock_guard<mutex> lock(rotate_mutex_);
+    publish_key();
+}
+
+void tls_session_cache::publish_key()
+{
+    ticket_key key;
+    RAND_bytes(key.name.data(), key.name.size());
+    RAND_bytes(key.aes_key.data(), key.aes_key.size());
+    RAND_bytes(key.hmac_key.data(), key.hmac_key.size());
+    key.created = chrono::steady_clock::now();
+    auto next = ring_.read([&](const key_ring &ring) {
+        auto next = make_unique<key_ring>();
+        next->keys.push_back(key);
+        for (auto &k: ring.keys)
+            if (next->keys.size() < max_keys_)
+                next->keys.push_back(k);
+        return next;
+    });
+    ring_.publish(move(next));
+    rotations_.fetch_add(1, memory_order_relaxed);
+}
+
+int tls_session_cache::seal(unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac)
+{
+    auto expired = [this] {
+        auto now = chrono::steady_clock::now();
+        return ring_.read([&](const key_ring &ring) {
+            return now - ring.keys.front().created >= key_lifetime_;
+        });
+    };
+    if (expired()) {
+        /* a single handshake makes the new key, the others go on with the
+         * old one meanwhile */
+        unique_lock<mutex> lock(rotate_mutex_, try_to_lock);
+        if (lock.owns_lock() && expired())
+            publish_key();
+    }
+    if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+        return -1;
+    return ring_.read([&](const key_ring &ring) {
+        auto &key = ring.keys.front();
+        memcpy(name, key.name.data(), key.name.size());
+        if (EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv) != 1 ||
+            !set_mac_key(mac, key.hmac_key))
+            return -1;
+        return 1;
+    });
+}
+
+int tls_session_cache::open(const unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac)
+{
+    return ring_.read([&](const key_ring &ring) {
+        for (size_t i = 0; i < ring.keys.size(); ++i) {
+            auto &key = ring.keys[i];
+            if (memcmp(name, key.name.data(), key.name.size()) != 0)
+                continue;
+            if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv) != 1 ||
+                !set_mac_key(mac, key.hmac_key))
+                return -1;
+            /* 2 renews the tickets of the previous keys */
+            return i == 0 ? 1 : 2;
+        }
+        return 0;   /* unknown or dropped key, full handshake */
+    });
+}
+
+int tls_session_cache::ticket_callback(
+    SSL *ssl,
+    unsigned char *name,
+    unsigned char *iv,
+    EVP_CIPHER_CTX *cipher,
+    EVP_MAC_CTX *mac,
+    int encrypt)
+{
+    auto cache = static_cast<tls_session_cache *>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), cache_index()));
+    if (!cache)
+        return 0;
+    return encrypt ?
+        cache->seal(name, iv, cipher, mac) :
+        cache->open(name, iv, cipher, mac);
+}
+
+}}
@@ -0,0 +1,99 @@
+#ifndef TLS_SESSION_CACHE_HPP_INCLUDED
+#define TLS_SESSION_CACHE_HPP_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <openssl/ssl.h>
+
+#include <src/riot/server/configuration.hpp>
+#include <src/riot/server/rcu_cell.hpp>
+
+namespace riot { namespace server {
+
+/**
+ * @brief tls session resumption of an ssl context, so that a device
+ * reconnecting within the session timeout skips the key exchange and the
+ * certificate.
+ *
+ * the sessions are resumed from tickets, sealed by the server with a key
+ * which rotates every tls_ticket_key_lifetime. the previous keys still open
+ * the tickets, which are renewed then, so a rotation doesn't make all the
+ * devices do full handshakes at once. the keys are random and never leave
+ * the process. the clients not supporting tickets resume from the session
+ * cache of the context, by session id.
+ *
+ * the keys are read without locking by the handshakes of all the threads,
+ * see rcu_cell. the context owns the installed object.
+ */
+class tls_session_cache {
+public:
+    tls_session_cache(const tls_session_cache &) = delete;
+    tls_session_cache &operator=(const tls_session_cache &) = delete;
+
+    /**
+     * @brief installs the session cache and the ticket keys on the context,
+     * as configured. only the first call has an effect, the servers sharing
+     * the context all call it when they start.
+     *
+     * @return tls_session_cache& the installed one.
+     */
+    static tls_session_cache &install(SSL_CTX *ctx, const server_configuration &config);
+
+    /**
+     * @brief seals the new tickets with a new key, the oldest key is
+     * dropped beyond tls_ticket_keys. the handshakes call it when the key
+     * is older than its lifetime.
+     *
+     */
+    void rotate();
+
+    /**
+     * @brief returns the number of the keys made so far.
+     *
+     * @return std::uint64_t
+     */
+    std::uint64_t rotations() const
+    { return rotations_.load(std::memory_order_relaxed); }
+private:
+    struct ticket_key {
+        std::array<unsigned char, 16> name;
+        std::array<unsigned char, 32> aes_key;
+        std::array<unsigned char, 32> hmac_key;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    struct key_ring {
+        std::vector<ticket_key> keys;   /* the newest first */
+    };
+
+    explicit tls_session_cache(const server_configuration &config);
+
+    std::chrono::seconds key_lifetime_;
+    std::size_t max_keys_;
+    std::mutex rotate_mutex_;           /* serializes the writers */
+    rcu_cell<key_ring> ring_;
+    std::atomic<std::uint64_t> rotations_ { 0 };
+
+    /* requires the rotate mutex */
+    void publish_key();
+
+    int seal(unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac);
+    int open(const unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac);
+
+    static int ticket_callback(
+        SSL *ssl,
+        unsigned char *name,
+        unsigned char *iv,
+        EVP_CIPHER_CTX *cipher,
+        EVP_MAC_CTX *mac,
+        int encrypt);
+};
+
+}}
+
+#endif // TLS_SESSION_CACHE_HPP_INCLUDED
@@ -0,0 +1,38 @@
+#ifndef TOKENIZER_HPP_INCLUDED
+#define TOKENIZER_HPP_INCLUDED
+
+#include <string_view>
+#include <cstddef>
+
+namespace riot { namespace server {
+
+/**
+ * @brief returns true for the characters separating the tokens of the
+ * header and command lines, the same as std::isspace in the "C" locale.
+ *
+ */
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * @brief extracts the next whitespace separated token from rest, in place.
+ *
+ * @param rest the rest of the line, the token is removed from it.
+ * @return std::string_view the token, empty if there are no more tokens.
+ */
+inline std::string_view next_token(std::string_view &rest) {
+    std::size_t i = 0;
+    while (i < rest.size() && is_space(rest[i]))
+        ++i;
+    std::size_t j = i;
+    while (j < rest.size() && !is_space(rest[j]))
+        ++j;
+    std::string_view token = rest.substr(i, j - i);
+    rest.remove_prefix(j);
+    return token;
+}
+
+}}
+
+#endif // TOKENIZER_HPP_INCLUDED
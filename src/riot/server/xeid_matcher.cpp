@@ -1,6 +1,9 @@
 #include "xeid_matcher.hpp"
 
 #include <iostream>
+#include <regex>
+#include <stdexcept>
+#include <cctype>
 
 namespace riot { namespace server {
 
@@ -9,7 +12,7 @@ xeid_matcher::xeid_matcher()
     do_cache();
 }
 
-xeid_matcher::xeid_matcher(const std::string& input)
+xeid_matcher::xeid_matcher(std::string_view input)
 {
     init(input);
 }
@@ -19,37 +22,63 @@ xeid_matcher::xeid_matcher(const xeid_matcher&) = default;
 xeid_matcher &xeid_matcher::operator=(xeid_matcher &&) = default;
 xeid_matcher &xeid_matcher::operator=(const xeid_matcher &) = default;
 
-void xeid_matcher::init(const std::string& input)
+void xeid_matcher::init(std::string_view input)
 {
-    std::regex re(R"(([^\s@#]+)(?:@([^\s@#]*)(?:#([^\s@#]*))?)?)");
-    std::smatch m;
-    std::regex_match(input, m, re);
-    eid = m[1];
-    dname = m[2];
-    dtype = m[3];
+    /* ([^\s@#]+)(?:@([^\s@#]*)(?:#([^\s@#]*))?)? */
+    auto component_end = [&input](std::size_t from) {
+        while (from < input.size() &&
+               input[from] != '@' &&
+               input[from] != '#' &&
+               !std::isspace(static_cast<unsigned char>(input[from])))
+            ++from;
+        return from;
+    };
+    auto invalid = [&input] {
+        throw std::invalid_argument("not an xeid: " + std::string(input));
+    };
+    std::size_t i = component_end(0);
+    if (i == 0)
+        invalid();
+    eid = input.substr(0, i);
+    dname.clear();
+    dtype.clear();
+    if (i != input.size()) {
+        if (input[i] != '@')
+            invalid();
+        std::size_t j = component_end(i + 1);
+        dname = input.substr(i + 1, j - i - 1);
+        if (j != input.size()) {
+            if (input[j] != '#')
+                invalid();
+            std::size_t k = component_end(j + 1);
+            if (k != input.size())
+                invalid();
+            dtype = input.substr(j + 1);
+        }
+    }
     do_cache();
 }
 
-bool xeid_matcher::matches(const std::string& eid_str, const std::string& dname_str, const std::string& dtype_str)
+bool xeid_matcher::matches(const std::string& eid_str, const std::string& dname_str, const std::string& dtype_str) const
 {
     return
-        (eid.empty() || std::regex_match(eid_str, reid_)) &&
-        (dname.empty() || std::regex_match(dname_str, rdname_)) &&
-        (dtype.empty() || std::regex_match(dtype_str, rdtype_));
+        peid_.matches(eid_str) &&
+        pdname_.matches(dname_str) &&
+        pdtype_.matches(dtype_str);
 }
 
-bool xeid_matcher::device_matches(const std::string& dname_str, const std::string& dtype_str)
+bool xeid_matcher::device_matches(const std::string& dname_str, const std::string& dtype_str) const
 {
     return 
-        (dname.empty() || std::regex_match(dname_str, rdname_)) &&
-        (dtype.empty() || std::regex_match(dtype_str, rdtype_));
+        pdname_.matches(dname_str) &&
+        pdtype_.matches(dtype_str);
 }
 
 void xeid_matcher::do_cache()
 {
-    reid_ = std::regex(eid);
-    rdname_ = std::regex(dname);
-    rdtype_ = std::regex(dtype);
+    peid_ = xeid_pattern(eid);
+    pdname_ = xeid_pattern(dname);
+    pdtype_ = xeid_pattern(dtype);
 }
 
 xeid_matcher & xeid_matcher::print()
@@ -2,11 +2,19 @@
 #define _xeid_matcher_included
 
 #include <string>
-#include <regex>
+#include <string_view>
 #include <ostream>
 
+#include <src/riot/server/xeid_pattern.hpp>
+
 namespace riot { namespace server {
 
+/**
+ * @brief matcher for the xeids of the form eid@dname#dtype, each component
+ * being a regular expression. the components are compiled into xeid_pattern
+ * objects by do_cache().
+ * 
+ */
 class xeid_matcher {
 public:
     std::string eid;
@@ -14,7 +22,7 @@ public:
     std::string dtype;
 public:
     xeid_matcher();
-    xeid_matcher(const std::string &input);
+    xeid_matcher(std::string_view input);
     
     xeid_matcher(xeid_matcher &&);
     xeid_matcher(const xeid_matcher&);
@@ -22,20 +30,34 @@ public:
     xeid_matcher &operator=(xeid_matcher &&);
     xeid_matcher &operator=(const xeid_matcher &);
     
-    void init(const std::string &input);
+    /**
+     * @brief parses and compiles the xeid.
+     * 
+     * @param input eid@dname#dtype, dname and dtype are optional.
+     * @throw std::invalid_argument if input is not an xeid.
+     * @throw std::regex_error if a component is not a valid expression.
+     */
+    void init(std::string_view input);
     bool matches(
         const std::string &eid_str,
         const std::string &dname_str,
         const std::string &dtype_str
-    );
+    ) const;
     bool device_matches(
         const std::string &dname_str,
         const std::string &dtype_str
-    );
+    ) const;
     void do_cache();
     xeid_matcher &print();
+    
+    const xeid_pattern &eid_pattern() const
+    { return peid_; }
+    const xeid_pattern &dname_pattern() const
+    { return pdname_; }
+    const xeid_pattern &dtype_pattern() const
+    { return pdtype_; }
 private:
-    std::regex reid_, rdname_, rdtype_;
+    xeid_pattern peid_, pdname_, pdtype_;
 };
 
 }}
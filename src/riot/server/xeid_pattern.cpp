@@ -0,0 +1,440 @@
+#include <bitset>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <cctype>
+
+#include <src/riot/server/xeid_pattern.hpp>
+
+namespace riot { namespace server {
+
+namespace {
+
+using charset = std::bitset<256>;
+
+/* thrown for the constructs the automaton does not support, the pattern is
+ * then handed over to std::regex, which also reports the syntax errors */
+struct unsupported {};
+
+/* upper limit on the number of the states of an automaton */
+constexpr std::size_t max_dfa_states = 512;
+
+struct nfa {
+    enum op_t { op_set, op_split, op_match };
+    struct state {
+        op_t op;
+        charset set;
+        int out { -1 };
+        int out1 { -1 };
+    };
+    std::vector<state> states;
+
+    int add(op_t op, const charset &set = charset()) {
+        states.push_back(state { op, set });
+        return static_cast<int>(states.size() - 1);
+    }
+};
+
+/* Thompson construction, a fragment is a start state and the list of its
+ * dangling arrows, (state, 0) for out and (state, 1) for out1 */
+struct fragment {
+    int start;
+    std::vector<std::pair<int, int>> outs;
+};
+
+class parser {
+public:
+    parser(const std::string &pattern, nfa &n) :
+        p_(pattern),
+        n_(n)
+    {}
+
+    int parse() {
+        fragment f = alternation();
+        if (pos_ != p_.size())
+            throw unsupported();
+        int m = n_.add(nfa::op_match);
+        patch(f, m);
+        return f.start;
+    }
+private:
+    const std::string &p_;
+    nfa &n_;
+    std::size_t pos_ { 0 };
+
+    bool at_end() const
+    { return pos_ >= p_.size(); }
+
+    char peek() const
+    { return p_[pos_]; }
+
+    void patch(const fragment &f, int target) {
+        for (auto &o: f.outs)
+            (o.second ? n_.states[o.first].out1 : n_.states[o.first].out) = target;
+    }
+
+    fragment epsilon() {
+        int s = n_.add(nfa::op_split);
+        return fragment { s, { { s, 0 } } };
+    }
+
+    fragment alternation() {
+        fragment f = concatenation();
+        while (!at_end() && peek() == '|') {
+            ++pos_;
+            fragment g = concatenation();
+            int s = n_.add(nfa::op_split);
+            n_.states[s].out = f.start;
+            n_.states[s].out1 = g.start;
+            f.start = s;
+            f.outs.insert(f.outs.end(), g.outs.begin(), g.outs.end());
+        }
+        return f;
+    }
+
+    fragment concatenation() {
+        if (at_end() || peek() == '|' || peek() == ')')
+            return epsilon();
+        fragment f = repetition();
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            fragment g = repetition();
+            patch(f, g.start);
+            f.outs = std::move(g.outs);
+        }
+        return f;
+    }
+
+    fragment repetition() {
+        fragment f = atom();
+        if (at_end())
+            return f;
+        char c = peek();
+        if (c == '*' || c == '+' || c == '?') {
+            ++pos_;
+            /* laziness doesn't change the set of the matched strings */
+            if (!at_end() && peek() == '?')
+                ++pos_;
+            int s = n_.add(nfa::op_split);
+            n_.states[s].out = f.start;
+            if (c == '*') {
+                patch(f, s);
+                f = fragment { s, { { s, 1 } } };
+            }
+            else if (c == '+') {
+                patch(f, s);
+                f.outs = { { s, 1 } };
+            }
+            else {
+                f.start = s;
+                f.outs.emplace_back(s, 1);
+            }
+            if (!at_end() && (peek() == '*' || peek() == '+' ||
+                              peek() == '?' || peek() == '{'))
+                throw unsupported();
+        }
+        else if (c == '{') {
+            throw unsupported();
+        }
+        return f;
+    }
+
+    fragment set_fragment(const charset &set) {
+        int s = n_.add(nfa::op_set, set);
+        return fragment { s, { { s, 0 } } };
+    }
+
+    fragment atom() {
+        char c = p_[pos_++];
+        switch (c) {
+        case '(': {
+            if (!at_end() && peek() == '?') {
+                if (p_.compare(pos_, 2, "?:") != 0)
+                    throw unsupported();
+                pos_ += 2;
+            }
+            fragment f = alternation();
+            if (at_end() || peek() != ')')
+                throw unsupported();
+            ++pos_;
+            return f;
+        }
+        case '[':
+            return set_fragment(bracket());
+        case '.': {
+            charset set;
+            set.set();
+            set.reset('\n');
+            set.reset('\r');
+            return set_fragment(set);
+        }
+        case '\\': {
+            charset set;
+            escape(set);
+            return set_fragment(set);
+        }
+        case '^': case '$': case ')': case ']': case '{': case '}':
+        case '*': case '+': case '?': case '|':
+            throw unsupported();
+        default: {
+            charset set;
+            set.set(static_cast<unsigned char>(c));
+            return set_fragment(set);
+        }
+        }
+    }
+
+    /* parses the escape sequence following a backslash into set, returns
+     * true if it denotes a single character */
+    bool escape(charset &set) {
+        if (at_end())
+            throw unsupported();
+        char c = p_[pos_++];
+        charset cls;
+        switch (c) {
+        case 'd': case 'D':
+            for (int i = '0'; i <= '9'; ++i) cls.set(i);
+            break;
+        case 'w': case 'W':
+            for (int i = '0'; i <= '9'; ++i) cls.set(i);
+            for (int i = 'a'; i <= 'z'; ++i) cls.set(i);
+            for (int i = 'A'; i <= 'Z'; ++i) cls.set(i);
+            cls.set('_');
+            break;
+        case 's': case 'S':
+            for (char w: { ' ', '\t', '\n', '\v', '\f', '\r' }) cls.set(w);
+            break;
+        case 'n': set.set('\n'); return true;
+        case 't': set.set('\t'); return true;
+        case 'r': set.set('\r'); return true;
+        case 'f': set.set('\f'); return true;
+        case 'v': set.set('\v'); return true;
+        default:
+            /* only the punctuation can be escaped to itself */
+            if (std::isalnum(static_cast<unsigned char>(c)) ||
+                static_cast<unsigned char>(c) >= 0x80)
+                throw unsupported();
+            set.set(static_cast<unsigned char>(c));
+            return true;
+        }
+        if (std::isupper(static_cast<unsigned char>(c)))
+            cls.flip();
+        set |= cls;
+        return false;
+    }
+
+    charset bracket() {
+        charset set;
+        bool negate = false;
+        if (!at_end() && peek() == '^') {
+            negate = true;
+            ++pos_;
+        }
+        /* "[]" and "[^]" are special in ECMAScript */
+        if (!at_end() && peek() == ']')
+            throw unsupported();
+        while (true) {
+            if (at_end())
+                throw unsupported();
+            char c = p_[pos_++];
+            if (c == ']')
+                break;
+            if (c == '[' && !at_end() &&
+                (peek() == ':' || peek() == '=' || peek() == '.'))
+                throw unsupported();
+            charset item;
+            bool single = true;
+            if (c == '\\')
+                single = escape(item);
+            else
+                item.set(static_cast<unsigned char>(c));
+            if (single && pos_ + 1 < p_.size() &&
+                peek() == '-' && p_[pos_ + 1] != ']') {
+                ++pos_;
+                char d = p_[pos_++];
+                if (d == '\\') {
+                    charset end;
+                    if (!escape(end))
+                        throw unsupported();
+                    for (int i = 0; i < 256; ++i)
+                        if (end[i]) d = static_cast<char>(i);
+                }
+                int lo = 0;
+                for (int i = 0; i < 256; ++i)
+                    if (item[i]) lo = i;
+                int hi = static_cast<unsigned char>(d);
+                if (lo > hi)
+                    throw unsupported();
+                for (int i = lo; i <= hi; ++i)
+                    item.set(i);
+            }
+            set |= item;
+        }
+        if (negate)
+            set.flip();
+        return set;
+    }
+};
+
+/* adds the states reachable by the epsilon arrows, keeps only the states
+ * consuming input and the match state */
+std::vector<int> closure(const nfa &n, std::vector<int> from) {
+    std::vector<int> result;
+    std::vector<bool> seen(n.states.size());
+    while (!from.empty()) {
+        int s = from.back();
+        from.pop_back();
+        if (s < 0 || seen[s])
+            continue;
+        seen[s] = true;
+        const auto &st = n.states[s];
+        if (st.op == nfa::op_split) {
+            from.push_back(st.out1);
+            from.push_back(st.out);
+        }
+        else {
+            result.push_back(s);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+}
+
+class xeid_pattern::automaton {
+public:
+    automaton(const nfa &n, int start) {
+        /* partition the bytes into classes which are indistinguishable by
+         * every character set of the expression */
+        std::map<std::vector<bool>, std::uint8_t> signatures;
+        std::vector<int> representatives;
+        for (int b = 0; b < 256; ++b) {
+            std::vector<bool> signature;
+            for (const auto &st: n.states)
+                if (st.op == nfa::op_set)
+                    signature.push_back(st.set[b]);
+            auto it = signatures.find(signature);
+            if (it == signatures.end()) {
+                it = signatures.emplace(
+                    std::move(signature),
+                    static_cast<std::uint8_t>(representatives.size())).first;
+                representatives.push_back(b);
+            }
+            classes_[b] = it->second;
+        }
+        nclasses_ = representatives.size();
+
+        /* subset construction, state 0 is the dead state */
+        std::map<std::vector<int>, std::uint16_t> ids;
+        std::vector<std::vector<int>> sets;
+        auto add_state = [&](std::vector<int> set) -> std::uint16_t {
+            auto it = ids.find(set);
+            if (it != ids.end())
+                return it->second;
+            if (sets.size() >= max_dfa_states)
+                throw unsupported();
+            auto id = static_cast<std::uint16_t>(sets.size());
+            bool accepting = false;
+            for (int s: set)
+                accepting = accepting || n.states[s].op == nfa::op_match;
+            accepting_.push_back(accepting);
+            next_.resize(next_.size() + nclasses_, 0);
+            ids.emplace(set, id);
+            sets.push_back(std::move(set));
+            return id;
+        };
+        add_state({});
+        start_ = add_state(closure(n, { start }));
+        for (std::size_t i = 1; i < sets.size(); ++i) {
+            for (std::size_t c = 0; c < nclasses_; ++c) {
+                std::vector<int> targets;
+                for (int s: sets[i]) {
+                    const auto &st = n.states[s];
+                    if (st.op == nfa::op_set && st.set[representatives[c]])
+                        targets.push_back(st.out);
+                }
+                auto target = add_state(closure(n, std::move(targets)));
+                next_[i * nclasses_ + c] = target;
+            }
+        }
+    }
+
+    bool matches(const std::string &str) const {
+        std::size_t s = start_;
+        for (unsigned char c: str) {
+            s = next_[s * nclasses_ + classes_[c]];
+            if (s == 0)
+                return false;
+        }
+        return accepting_[s];
+    }
+private:
+    std::uint8_t classes_[256];
+    std::size_t nclasses_;
+    std::vector<std::uint16_t> next_;
+    std::vector<char> accepting_;
+    std::uint16_t start_;
+};
+
+xeid_pattern::xeid_pattern()
+{}
+
+xeid_pattern::xeid_pattern(const std::string &pattern)
+{
+    static const char *meta = ".^$|()[]{}*+?\\";
+    if (pattern.empty() || pattern == ".*") {
+        kind_ = any;
+        return ;
+    }
+    auto pos = pattern.find_first_of(meta);
+    if (pos == std::string::npos) {
+        kind_ = literal;
+        key_ = pattern;
+        return ;
+    }
+    if (pos == pattern.size() - 2 && pattern.compare(pos, 2, ".*") == 0) {
+        kind_ = prefix;
+        key_ = pattern.substr(0, pos);
+        return ;
+    }
+    if (pattern.compare(0, 2, ".*") == 0 &&
+        pattern.find_first_of(meta, 2) == std::string::npos) {
+        kind_ = suffix;
+        key_ = pattern.substr(2);
+        return ;
+    }
+    try {
+        nfa n;
+        int start = parser(pattern, n).parse();
+        dfa_ = std::make_shared<const automaton>(n, start);
+        kind_ = dfa;
+    }
+    catch (unsupported &) {
+        regex_ = std::make_shared<const std::regex>(
+            pattern, std::regex::ECMAScript | std::regex::optimize);
+        kind_ = regex;
+    }
+}
+
+bool xeid_pattern::matches(const std::string &str) const
+{
+    switch (kind_) {
+    case any:
+        return true;
+    case literal:
+        return str == key_;
+    case prefix:
+        return str.size() >= key_.size() &&
+            str.compare(0, key_.size(), key_) == 0;
+    case suffix:
+        return str.size() >= key_.size() &&
+            str.compare(str.size() - key_.size(), key_.size(), key_) == 0;
+    case dfa:
+        return dfa_->matches(str);
+    case regex:
+        return std::regex_match(str, *regex_);
+    }
+    return false;
+}
+
+}}
@@ -0,0 +1,78 @@
+#ifndef _xeid_pattern_included
+#define _xeid_pattern_included
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <regex>
+#include <cstdint>
+
+namespace riot { namespace server {
+
+/**
+ * @brief a single component (eid, dname or dtype) of an xeid, which is an
+ * ECMAScript regular expression matched against the whole string.
+ *
+ * the expression is classified once, when constructed, and matching
+ * dispatches to the cheapest sufficient implementation:
+ *  - any: empty pattern or ".*", always matches,
+ *  - literal: no special characters, string comparison,
+ *  - prefix: "literal.*", prefix comparison,
+ *  - suffix: ".*literal", suffix comparison,
+ *  - dfa: other expressions using only literals, ".", character classes,
+ *    groups, alternation and the "*", "+", "?" quantifiers are compiled into
+ *    a deterministic automaton,
+ *  - regex: everything else falls back to std::regex.
+ *
+ * compiled automata are immutable and shared between copies.
+ */
+class xeid_pattern {
+public:
+    enum kind_t {
+        any = 0,
+        literal,
+        prefix,
+        suffix,
+        dfa,
+        regex
+    };
+
+    xeid_pattern();
+
+    /**
+     * @brief compiles the pattern.
+     *
+     * @param pattern regular expression.
+     * @throw std::regex_error if pattern is not a valid regular expression.
+     */
+    explicit xeid_pattern(const std::string &pattern);
+
+    kind_t kind() const
+    { return kind_; }
+
+    /**
+     * @brief returns the literal part of literal, prefix and suffix
+     * patterns, an empty string otherwise.
+     *
+     * @return const std::string&
+     */
+    const std::string &key() const
+    { return key_; }
+
+    bool matches(const std::string &str) const;
+
+    /**
+     * @brief deterministic automaton over byte classes.
+     *
+     */
+    class automaton;
+private:
+    kind_t kind_ { any };
+    std::string key_;
+    std::shared_ptr<const automaton> dfa_;
+    std::shared_ptr<const std::regex> regex_;
+};
+
+}}
+
+#endif // _xeid_pattern_included